@@ -0,0 +1,92 @@
+#ifndef CIORAN_BARRIERS_H
+#define CIORAN_BARRIERS_H
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace cioran {
+    // The state an image was left in by its last use.
+    // The stage and access masks are what a later barrier has to wait for before the image can be used again.
+    struct ImageState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+        // The queue family that owns the image. VK_QUEUE_FAMILY_IGNORED until it is first used.
+        // Transitions keep the owner as it is, it only changes through a release and acquire.
+        uint32_t queue_family = VK_QUEUE_FAMILY_IGNORED;
+    };
+
+    // The ways we use images. Each one maps to the layout, pipeline stages and memory accesses of that use.
+    enum class ImageUsage {
+        transfer_src,
+        transfer_dst,
+        compute_storage_read,
+        compute_storage_write,
+        compute_storage_read_write,
+        compute_sampled,
+        fragment_sampled,
+        color_attachment,
+        depth_attachment,
+        present
+    };
+
+    ImageState image_state_for(ImageUsage usage);
+
+    // The same as ImageState, for buffers. Buffers don't have layouts.
+    struct BufferState {
+        VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+        uint32_t queue_family = VK_QUEUE_FAMILY_IGNORED;
+    };
+
+    enum class BufferUsage {
+        transfer_src,
+        transfer_dst,
+        compute_storage_read,
+        compute_storage_write,
+        compute_storage_read_write,
+        uniform_read,
+        vertex_input,
+        index_input,
+        indirect_argument,
+        host_read
+    };
+
+    BufferState buffer_state_for(BufferUsage usage);
+
+    // Collects image and buffer transitions, and records them all with a single vkCmdPipelineBarrier2.
+    //
+    // Each transition is computed from the tracked state of the image and its next use, so the barrier
+    // only waits for the stages that actually touched the image, and only makes the accesses of the next use wait.
+    // Transitions between two read-only uses in the same layout don't need a barrier at all, and are skipped.
+    //
+    // An image should only be transitioned once per batch. To use an image in more than one way,
+    // flush the batch in between the uses.
+    struct BarrierBatch {
+        std::vector<VkImageMemoryBarrier2> image_barriers;
+        std::vector<VkBufferMemoryBarrier2> buffer_barriers;
+
+        // Transitions an image from its tracked state to the given use, and updates the tracked state.
+        // If discard_contents is set, the old contents are not preserved, which lets the driver skip work for the layout transition.
+        void transition(VkImage image, ImageState& state, ImageUsage next_usage, bool discard_contents = false);
+        // Makes the whole buffer available to the given use, and updates the tracked state.
+        void transition(VkBuffer buffer, BufferState& state, BufferUsage next_usage);
+
+        // Queue family ownership transfers, for resources with exclusive sharing that move between queues.
+        // The release is recorded on the queue that owns the resource, and the acquire on the queue that takes it over.
+        // Both have to describe the same layout transition, which then only happens once.
+        // The acquire has to be ordered after the release by a semaphore, which the queue taking over waits on at the stages of next_usage.
+        void release(VkImage image, const ImageState& state, ImageUsage next_usage, uint32_t dst_queue_family);
+        void acquire(VkImage image, ImageState& state, ImageUsage next_usage, uint32_t dst_queue_family);
+        void release(VkBuffer buffer, const BufferState& state, BufferUsage next_usage, uint32_t dst_queue_family);
+        void acquire(VkBuffer buffer, BufferState& state, BufferUsage next_usage, uint32_t dst_queue_family);
+
+        // Records all pending barriers into the command buffer, and clears the batch.
+        void flush(VkCommandBuffer cmd);
+
+        bool empty() const;
+    };
+}
+
+#endif // CIORAN_BARRIERS_H
@@ -0,0 +1,92 @@
+#ifndef CIORAN_BINDLESS_H
+#define CIORAN_BINDLESS_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_mem_alloc.h"
+
+#include "cioran-descriptor-buffer.h"
+#include "cioran-descriptors.h"
+#include "cioran-layout-cache.h"
+
+namespace cioran {
+    // The bindings of the bindless set. Shaders declare them as unsized arrays, for example:
+    // layout(set = 0, binding = 0, rgba16f) uniform image2D storage_images[];
+    constexpr uint32_t BINDLESS_STORAGE_IMAGE_BINDING { 0 };
+    constexpr uint32_t BINDLESS_SAMPLED_IMAGE_BINDING { 1 };
+    constexpr uint32_t BINDLESS_SAMPLER_BINDING { 2 };
+    constexpr uint32_t BINDLESS_STORAGE_BUFFER_BINDING { 3 };
+
+    // The largest arrays we ask for. Devices with lower limits get smaller arrays.
+    constexpr uint32_t MAX_BINDLESS_IMAGES { 16384 };
+    constexpr uint32_t MAX_BINDLESS_SAMPLERS { 256 };
+    constexpr uint32_t MAX_BINDLESS_BUFFERS { 16384 };
+
+    // One global descriptor set that holds every image, sampler and buffer, indexed by shaders with 32-bit indices.
+    //
+    // Instead of allocating and binding descriptor sets per draw or dispatch, the set is bound once per command buffer
+    // and shaders receive the indices of the resources they need, usually through push constants.
+    // The index of a resource is the index of its handle in the resource registry.
+    //
+    // The arrays are partially bound, so only the elements a shader actually reads have to be valid.
+    // They are also update after bind, with updates allowed while pending, so elements can be written
+    // while command buffers using the set are still recorded or executing, as long as those don't use the written elements.
+    //
+    // Writes can come from any thread. They are gathered in a DescriptorWriter and applied with a single vkUpdateDescriptorSets in flush().
+    //
+    // Pipelines that read their other sets from descriptor buffers can't bind regular descriptor sets, so with the buffer backend
+    // the heap lives in a descriptor buffer of its own instead. There is no update after bind in descriptor buffers, and none is needed:
+    // a write copies the descriptor straight into the buffer, where it only touches the bytes of its own element.
+    // The buffer is bound along with the frame's descriptor buffer, see FrameDescriptors::bind_heap().
+    struct BindlessHeap {
+        VkDevice device;
+        VkDescriptorPool pool;
+        // Owned by the layout cache the heap was created with.
+        VkDescriptorSetLayout layout;
+        VkDescriptorSet set;
+
+        // Only used when the heap lives in a descriptor buffer.
+        bool in_descriptor_buffer;
+        VmaAllocator allocator;
+        DescriptorBufferAllocator descriptor_buffer;
+        DescriptorBufferSet buffer_set;
+
+        // The size of each array, after clamping to the device's limits.
+        uint32_t image_capacity;
+        uint32_t sampler_capacity;
+        uint32_t buffer_capacity;
+
+        // Guards everything below.
+        std::mutex mutex;
+        DescriptorWriter writer;
+        uint32_t sampler_count;
+        // Whether the descriptor buffer was written since the last flush.
+        bool buffer_written;
+
+        // With an allocator, the heap lives in a descriptor buffer. The device must have VK_EXT_descriptor_buffer enabled then.
+        void init(VkDevice device, VkPhysicalDevice physical_device, DescriptorLayoutCache& layout_cache, VmaAllocator descriptor_buffer_allocator = VK_NULL_HANDLE);
+        void destroy();
+        void init_descriptor_buffer(VkPhysicalDevice physical_device, DescriptorLayoutCache& layout_cache);
+
+        void write_storage_image(uint32_t index, VkImageView view);
+        void write_sampled_image(uint32_t index, VkImageView view);
+        // In a descriptor buffer, buffers are referenced by their device address, so the buffer needs VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        // and the range has to be given.
+        void write_storage_buffer(uint32_t index, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+        // Samplers are few and live as long as the renderer, so they are simply appended. Returns the sampler's index.
+        uint32_t add_sampler(VkSampler sampler);
+
+        // Applies all pending writes. Called by the render thread before recording a frame that might use the written elements.
+        void flush();
+
+        // Binds the set at set 0 of the layout, which must have been built with the heap's layout as its first set.
+        // Not for a heap in a descriptor buffer, which is bound through FrameDescriptors::bind_heap().
+        void bind(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout) const;
+    };
+}
+
+#endif // CIORAN_BINDLESS_H
@@ -0,0 +1,50 @@
+#ifndef CIORAN_COMMANDS_H
+#define CIORAN_COMMANDS_H
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "cioran-jobs.h"
+
+namespace cioran {
+    // Command pools are externally synchronized, so two threads may never record into command buffers from the same pool at the same time.
+    // To record in parallel, each thread of the job system therefore gets its own command pool for each frame in flight.
+    // The worker records into secondary command buffers, which the primary command buffer executes in order.
+    struct WorkerCommandPool {
+        VkCommandPool pool;
+        std::vector<VkCommandBuffer> secondaries;
+        // How many of the secondaries have been handed out since the last reset.
+        uint32_t used;
+
+        VkCommandBuffer next_secondary(VkDevice device);
+    };
+
+    // A command recording task records a part of the frame into the given command buffer.
+    using RecordTask = std::function<void(VkCommandBuffer)>;
+
+    struct FrameCommands {
+        VkCommandPool primary_pool;
+        VkCommandBuffer primary;
+        std::vector<WorkerCommandPool> workers;
+
+        // worker_count has to match the number of threads in the job system that records.
+        void init(VkDevice device, uint32_t queue_family_index, uint32_t worker_count);
+        void destroy(VkDevice device);
+
+        // Resets all the command pools, which recycles every command buffer allocated from them at once.
+        // This is cheaper than resetting each command buffer individually, but the frame's GPU work must have completed.
+        void reset(VkDevice device);
+
+        // Records each task into its own secondary command buffer, spread across the threads of the job system.
+        // The returned secondaries are in the same order as the tasks, so they can be executed in that order.
+        std::vector<VkCommandBuffer> record_parallel(VkDevice device, JobSystem& jobs, std::span<RecordTask> tasks);
+    };
+
+    VkCommandBuffer create_secondary_command_buffer(VkDevice logicalDevice, VkCommandPool command_pool);
+}
+
+#endif // CIORAN_COMMANDS_H
@@ -0,0 +1,101 @@
+#ifndef CIORAN_DEFERRED_H
+#define CIORAN_DEFERRED_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_mem_alloc.h"
+
+#include "cioran-settings.h"
+
+namespace cioran {
+    enum class RetiredHandleType : uint32_t {
+        image,
+        image_view,
+        buffer,
+        allocation,
+        sampler,
+        pipeline,
+        pipeline_layout,
+        descriptor_set_layout,
+        descriptor_pool,
+        shader_module
+    };
+
+    // A Vulkan handle waiting to be destroyed. Non-dispatchable handles always fit into 64 bits.
+    // Images and buffers created through VMA carry their allocation, which is freed together with them.
+    struct RetiredHandle {
+        RetiredHandleType type;
+        uint64_t handle;
+        VmaAllocation allocation;
+    };
+
+    // The number of epochs that can be waiting to be destroyed at the same time.
+    // An epoch is collected once the GPU has finished it, which is at most MAX_FRAMES_IN_FLIGHT epochs later.
+    constexpr uint32_t DEFERRED_EPOCH_COUNT { MAX_FRAMES_IN_FLIGHT + 1 };
+
+    // Destroys Vulkan objects once the GPU can no longer be using them.
+    //
+    // Time is divided into epochs, one per frame. A handle retired during an epoch might still be used by the GPU work
+    // submitted in that epoch, so it is destroyed once the GPU has finished that epoch.
+    //
+    // Each epoch has a bucket with a fixed size array of handles. Retiring a handle from any thread reserves a slot
+    // with an atomic increment and writes the handle into it, so there are no locks and no allocations.
+    // Only if a bucket runs full, the rest of the handles go into an overflow list behind a mutex.
+    //
+    // The render thread drives the epochs:
+    // - begin_epoch() when a frame starts, which makes retirements go into that frame's bucket.
+    // - collect() once the GPU has finished an epoch, which destroys everything retired in it and before it.
+    struct DeferredDestroyer {
+        struct Bucket {
+            std::atomic<uint64_t> epoch;
+            std::atomic<uint32_t> count;
+            // The number of threads currently writing into the bucket. Collecting waits for them to finish.
+            std::atomic<uint32_t> writers;
+            std::unique_ptr<RetiredHandle[]> handles;
+
+            std::mutex overflow_mutex;
+            std::vector<RetiredHandle> overflow;
+        };
+
+        VkDevice device;
+        VmaAllocator allocator;
+        uint32_t bucket_capacity;
+
+        std::atomic<uint64_t> current_epoch;
+        std::array<Bucket, DEFERRED_EPOCH_COUNT> buckets;
+
+        void init(VkDevice device, VmaAllocator allocator, uint32_t bucket_capacity = 4096);
+        // Destroys everything that is still retired. The GPU must be idle.
+        void destroy();
+
+        // Starts a new epoch. Epochs must not decrease, and the epoch DEFERRED_EPOCH_COUNT before it must have been collected.
+        void begin_epoch(uint64_t epoch);
+        // Destroys every handle retired in the given epoch or before it. The GPU must be done with all of those epochs.
+        void collect(uint64_t completed_epoch);
+
+        void retire(RetiredHandleType type, uint64_t handle, VmaAllocation allocation = VK_NULL_HANDLE);
+
+        void retire_image(VkImage image, VmaAllocation allocation = VK_NULL_HANDLE);
+        void retire_image_view(VkImageView image_view);
+        void retire_buffer(VkBuffer buffer, VmaAllocation allocation);
+        void retire_allocation(VmaAllocation allocation);
+        void retire_sampler(VkSampler sampler);
+        void retire_pipeline(VkPipeline pipeline);
+        void retire_pipeline_layout(VkPipelineLayout pipeline_layout);
+        void retire_descriptor_set_layout(VkDescriptorSetLayout layout);
+        void retire_descriptor_pool(VkDescriptorPool pool);
+        void retire_shader_module(VkShaderModule shader_module);
+
+        void destroy_bucket(Bucket& bucket);
+        void destroy_handle(const RetiredHandle& retired);
+    };
+}
+
+#endif // CIORAN_DEFERRED_H
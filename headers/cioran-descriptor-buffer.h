@@ -0,0 +1,104 @@
+#ifndef CIORAN_DESCRIPTOR_BUFFER_H
+#define CIORAN_DESCRIPTOR_BUFFER_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_mem_alloc.h"
+
+#include "cioran-vulkan.h"
+
+namespace cioran {
+    // The default size of each frame's descriptor buffer.
+    constexpr VkDeviceSize DEFAULT_DESCRIPTOR_BUFFER_SIZE { 256 * 1024 };
+
+    // The functions of VK_EXT_descriptor_buffer. They are extension functions, so they have to be fetched from the device.
+    struct DescriptorBufferFunctions {
+        PFN_vkGetDescriptorSetLayoutSizeEXT get_layout_size;
+        PFN_vkGetDescriptorSetLayoutBindingOffsetEXT get_binding_offset;
+        PFN_vkGetDescriptorEXT get_descriptor;
+        PFN_vkCmdBindDescriptorBuffersEXT bind_buffers;
+        PFN_vkCmdSetDescriptorBufferOffsetsEXT set_offsets;
+
+        void load(VkDevice device);
+    };
+
+    // The limits of VK_EXT_descriptor_buffer on the device, like the size of each kind of descriptor.
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT query_descriptor_buffer_properties(VkPhysicalDevice physical_device);
+
+    // A descriptor set that lives in a descriptor buffer. It's nothing but a range of the buffer laid out like its layout.
+    struct DescriptorBufferSet {
+        VkDescriptorSetLayout layout;
+        VkDeviceSize offset;
+        uint8_t* pointer;
+    };
+
+    // The descriptor buffer backend of DescriptorAllocator, for descriptor sets that only live for a frame.
+    //
+    // Instead of allocating sets from a pool and writing them with vkUpdateDescriptorSets, the descriptors are written
+    // straight into a host visible buffer, like the frame allocator does with constants. Allocating a set moves a pointer forward,
+    // writing a descriptor copies its bytes from vkGetDescriptorEXT into the set's range, and binding a set only passes its offset.
+    // Freeing the sets is moving the pointer back to the start once the GPU is done with the frame.
+    // With the buffer backend, the bindless heap keeps its one set in a buffer of its own too.
+    //
+    // Layouts of sets allocated from here must be created with VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT,
+    // and pipelines using them with VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT. Such pipelines can't also bind regular descriptor sets.
+    //
+    // A command buffer has a single list of bound descriptor buffers, which every bind replaces.
+    // So when sets come from several buffers, their binding_info()s are bound together in one call, and each set names the buffer it's in by its index in that call.
+    //
+    // Like DescriptorAllocator, it is not thread safe. Each one should be used by a single thread at a time.
+    struct DescriptorBufferAllocator {
+        VkDevice device;
+        DescriptorBufferFunctions functions;
+        VkPhysicalDeviceDescriptorBufferPropertiesEXT properties;
+
+        AllocatedBuffer buffer;
+        // Resource buffers hold images and buffers, sampler buffers hold samplers. Combined image samplers need both.
+        VkBufferUsageFlags usage;
+        uint8_t* mapped;
+        VkDeviceAddress base_address;
+        VkDeviceSize capacity;
+        VkDeviceSize head;
+
+        // The size of each layout, which doesn't change, so it's only asked for once.
+        std::vector<std::pair<VkDescriptorSetLayout, VkDeviceSize>> layout_sizes;
+
+        // The device must have VK_EXT_descriptor_buffer enabled, see enable_descriptor_buffer().
+        // The usage is VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT, VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT, or both.
+        void init(VkDevice device, VkPhysicalDevice physical_device, VmaAllocator allocator, VkDeviceSize capacity = DEFAULT_DESCRIPTOR_BUFFER_SIZE,
+            VkBufferUsageFlags usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT);
+        void destroy(VmaAllocator allocator);
+
+        // Frees every set allocated from the buffer. The GPU must be done with all of them.
+        void reset();
+
+        DescriptorBufferSet allocate(VkDescriptorSetLayout layout);
+
+        void write_storage_image(const DescriptorBufferSet& set, uint32_t binding, VkImageView view, uint32_t array_element = 0);
+        void write_sampled_image(const DescriptorBufferSet& set, uint32_t binding, VkImageView view, VkImageLayout layout, uint32_t array_element = 0);
+        void write_sampler(const DescriptorBufferSet& set, uint32_t binding, VkSampler sampler, uint32_t array_element = 0);
+        void write_combined_image_sampler(const DescriptorBufferSet& set, uint32_t binding, VkSampler sampler, VkImageView view, VkImageLayout layout, uint32_t array_element = 0);
+        // Buffers are referenced by their device address, so there is no VkBuffer involved.
+        void write_uniform_buffer(const DescriptorBufferSet& set, uint32_t binding, VkDeviceAddress address, VkDeviceSize range, uint32_t array_element = 0);
+        void write_storage_buffer(const DescriptorBufferSet& set, uint32_t binding, VkDeviceAddress address, VkDeviceSize range, uint32_t array_element = 0);
+
+        // What vkCmdBindDescriptorBuffersEXT needs to bind the buffer. Buffers are bound once per command buffer, before any set is bound.
+        VkDescriptorBufferBindingInfoEXT binding_info() const;
+        // Binds only this buffer, as buffer 0.
+        void bind_buffer(VkCommandBuffer cmd) const;
+        // Points the set index of the pipeline layout at the set, in the buffer that was bound at buffer_index. There are no descriptor set objects to bind.
+        void bind_set(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index, const DescriptorBufferSet& set,
+            uint32_t buffer_index = 0) const;
+
+        // Makes the writes visible to the GPU, if the memory isn't coherent. Call before submitting the frame.
+        void flush(VmaAllocator allocator);
+
+        void write_descriptor(const DescriptorBufferSet& set, uint32_t binding, uint32_t array_element, const VkDescriptorGetInfoEXT& info, size_t descriptor_size);
+    };
+}
+
+#endif // CIORAN_DESCRIPTOR_BUFFER_H
@@ -1,37 +1,147 @@
 #ifndef CIORAN_DESCRIPTORS_H
 #define CIORAN_DESCRIPTORS_H
 
+#include <deque>
 #include <vector>
 #include <span>
 
 #include <vulkan/vulkan.h>
 
+#include "cioran-layout-cache.h"
+
 namespace cioran {
     struct DescriptorLayoutBuilder {
         std::vector<VkDescriptorSetLayoutBinding> bindings;
 
-        void add_binding(uint32_t binding, VkDescriptorType type);
+        // A count above 1 makes the binding an array of descriptors.
+        void add_binding(uint32_t binding, VkDescriptorType type, uint32_t count = 1);
         void clear();
         VkDescriptorSetLayout build(VkDevice device, VkShaderStageFlags stage_flags, void* pNext = nullptr, VkDescriptorSetLayoutCreateFlags flags = 0);
+        // Gets the layout from the cache instead of creating a new one each time. The cache owns the layout.
+        VkDescriptorSetLayout build(DescriptorLayoutCache& layout_cache, VkShaderStageFlags stage_flags, VkDescriptorSetLayoutCreateFlags flags = 0,
+            std::span<const VkDescriptorBindingFlags> binding_flags = {});
     };
 
     // Descriptor pools are used to allocate memory for descriptor sets.
     // They also manage the lifecycle of descriptor sets.
     // When you clear / reset a pool, it destroys all of the descriptor sets allocated from it.
+    //
+    // This allocator keeps a list of pools, and creates a bigger one whenever the current one runs out,
+    // so it never fails because a workload needs more sets than expected.
+    // It's meant to be cleared all at once, for example one allocator per frame that is cleared once the GPU is done with the frame.
+    //
+    // The pools are sized from ratios of descriptors per set. The allocator counts the descriptors that were actually allocated,
+    // and when a frame needed more than one pool, clearing replaces the pools with a single pool sized for what was used.
+    // After a few frames every frame fits into one pool, which clears in a single vkResetDescriptorPool.
+    //
+    // An allocator is not thread safe. Each one should be used by a single thread at a time.
     struct DescriptorAllocator {
         struct PoolSizeRatio {
             VkDescriptorType type;
             float ratio;
         };
 
-        VkDescriptorPool pool;
+        // The number of sets a frame's first pool is made for. It starts small, and clearing resizes the pool to what frames actually allocate.
+        static constexpr uint32_t INITIAL_SETS_PER_POOL { 16 };
+        // Pools are never made bigger than this many sets.
+        static constexpr uint32_t MAX_SETS_PER_POOL { 4092 };
+
+        std::vector<PoolSizeRatio> ratios;
+        // Pools that ran out of space, and pools that can still be allocated from.
+        std::vector<VkDescriptorPool> full_pools;
+        std::vector<VkDescriptorPool> ready_pools;
+        // The number of sets the next new pool is created with.
+        uint32_t sets_per_pool;
+
+        // What was allocated since the last clear, which the ratios are adapted to.
+        uint32_t allocated_sets;
+        std::vector<PoolSizeRatio> allocated_descriptors;
+
+        void init(VkDevice device, uint32_t initial_sets, std::span<const PoolSizeRatio> pool_ratios);
+        // Frees every set allocated from the allocator. The GPU must be done with all of them.
+        void clear_pools(VkDevice device);
+        void destroy_pools(VkDevice device);
+
+        // Allocates a set with the layout. The bindings the layout was built from are optional,
+        // and used to count what was allocated, so the pool sizes can adapt to the workload.
+        // They are also what a set that is too big for a new pool gets its own pool sized from, so without them such a set can't be allocated.
+        VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout, std::span<const VkDescriptorSetLayoutBinding> bindings = {}, void* pNext = nullptr);
+
+        VkDescriptorPool get_pool(VkDevice device);
+        VkDescriptorPool create_pool(VkDevice device, uint32_t set_count, std::span<const PoolSizeRatio> pool_ratios);
+        // The descriptors of a single set with the bindings, as ratios for a pool of one set.
+        static std::vector<PoolSizeRatio> set_pool_ratios(std::span<const VkDescriptorSetLayoutBinding> bindings);
+        void count_allocation(std::span<const VkDescriptorSetLayoutBinding> bindings);
+    };
+
+    // The functions of VK_KHR_push_descriptor. They are extension functions, so they have to be fetched from the device.
+    struct PushDescriptorFunctions {
+        PFN_vkCmdPushDescriptorSetKHR push_set;
+        PFN_vkCmdPushDescriptorSetWithTemplateKHR push_set_with_template;
+
+        // Leaves the functions null if the extension isn't enabled.
+        void load(VkDevice device);
+        bool supported() const { return push_set != nullptr && push_set_with_template != nullptr; }
+    };
+
+    // Gathers descriptor writes, and applies them in a single driver call.
+    //
+    // Writes are recorded first and aimed at a set afterwards with update_set(), so one writer can fill many sets.
+    // flush() then applies every write of every set with one vkUpdateDescriptorSets, instead of one call per write.
+    // Alternatively, push() records the writes into a command buffer as push descriptors, for resources that change
+    // with every dispatch or draw. Push descriptors need no set to be allocated at all.
+    //
+    // The image and buffer infos are kept in deques, so the pointers the writes hold stay valid as more are added.
+    // A writer is not thread safe.
+    struct DescriptorWriter {
+        std::deque<VkDescriptorImageInfo> image_infos;
+        std::deque<VkDescriptorBufferInfo> buffer_infos;
+        std::vector<VkWriteDescriptorSet> writes;
+        // Writes from here on haven't been aimed at a set yet.
+        size_t first_unassigned_write { 0 };
+
+        void write_image(uint32_t binding, VkImageView view, VkSampler sampler, VkImageLayout layout, VkDescriptorType type, uint32_t array_element = 0);
+        void write_buffer(uint32_t binding, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset, VkDescriptorType type, uint32_t array_element = 0);
+
+        // Aims the writes made since the last update_set() or push() at the set.
+        void update_set(VkDescriptorSet set);
+        // Applies every write that was aimed at a set with one vkUpdateDescriptorSets, and clears the writer.
+        // Writes that were never aimed at a set are dropped.
+        void flush(VkDevice device);
+        // Pushes the writes made since the last update_set() or push() as set set_index of the pipeline layout,
+        // whose set layout must have been created with VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR.
+        void push(VkCommandBuffer cmd, const PushDescriptorFunctions& functions, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index);
+        void clear();
+    };
+
+    // Describes where a descriptor lives in a packed CPU struct, for a DescriptorUpdateTemplate.
+    // The member is a VkDescriptorImageInfo, VkDescriptorBufferInfo or VkBufferView, depending on the type.
+    // Arrays of count elements are read with the given stride between elements.
+    VkDescriptorUpdateTemplateEntry update_template_entry(uint32_t binding, VkDescriptorType type, size_t offset, size_t stride, uint32_t count = 1, uint32_t array_element = 0);
+
+    // Updates or pushes a whole set from a packed CPU struct in one call, with a layout that is described once up front.
+    //
+    // Instead of building a VkWriteDescriptorSet per binding every time, the driver reads the descriptors straight out of the struct,
+    // which is the fastest way to fill sets whose contents change all the time.
+    // A template made with init() updates sets. One made with init_push() pushes them, and is tied to one set index of one pipeline layout.
+    struct DescriptorUpdateTemplate {
+        VkDescriptorUpdateTemplate update_template;
+        VkPipelineLayout pipeline_layout;
+        uint32_t set_index;
+
+        void init(VkDevice device, VkDescriptorSetLayout layout, std::span<const VkDescriptorUpdateTemplateEntry> entries);
+        void init_push(VkDevice device, VkDescriptorSetLayout layout, std::span<const VkDescriptorUpdateTemplateEntry> entries,
+            VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index);
+        void destroy(VkDevice device);
 
-        void init_pool(VkDevice device, uint32_t max_sets, std::span<PoolSizeRatio> pool_ratios);
-        void clear_descriptors(VkDevice device);
-        void destroy_pool(VkDevice device);
+        void update(VkDevice device, VkDescriptorSet set, const void* data) const;
+        void push(VkCommandBuffer cmd, const PushDescriptorFunctions& functions, const void* data) const;
 
-        VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout);
+        template<typename T>
+        void update(VkDevice device, VkDescriptorSet set, const T& data) const { update(device, set, (const void*)&data); }
+        template<typename T>
+        void push(VkCommandBuffer cmd, const PushDescriptorFunctions& functions, const T& data) const { push(cmd, functions, (const void*)&data); }
     };
 }
 
-#endif // CIORAN_DESCRIPTORS_H
\ No newline at end of file
+#endif // CIORAN_DESCRIPTORS_H
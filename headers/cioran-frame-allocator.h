@@ -0,0 +1,65 @@
+#ifndef CIORAN_FRAME_ALLOCATOR_H
+#define CIORAN_FRAME_ALLOCATOR_H
+
+#include <cstdint>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_mem_alloc.h"
+
+#include "cioran-vulkan.h"
+
+namespace cioran {
+    // The default size of each frame's allocator.
+    constexpr VkDeviceSize DEFAULT_FRAME_ALLOCATOR_SIZE { 1024 * 1024 };
+
+    // A piece of a frame allocator's buffer.
+    // It can be bound as a uniform or storage buffer with the offset as the dynamic offset,
+    // or read from a shader through its device address.
+    struct FrameAllocation {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        void* pointer;
+        VkDeviceAddress address;
+    };
+
+    // A linear allocator for data that only lives for one frame, like per frame and per draw constants.
+    //
+    // Each frame in flight owns one. It is a host visible buffer that stays mapped, and allocating moves a pointer forward.
+    // Once the frame's GPU work is done, the whole buffer is freed at once by moving the pointer back to the start.
+    // Data is written straight into the buffer, so there are no buffers to create and no descriptors to write per draw.
+    //
+    // Allocations are made on the thread that builds the frame. The recording tasks only use the results.
+    struct FrameAllocator {
+        AllocatedBuffer buffer;
+        uint8_t* mapped;
+        VkDeviceAddress base_address;
+        VkDeviceSize capacity;
+        VkDeviceSize head;
+        // Every allocation is aligned to this, so it can be used as a dynamic offset for both uniform and storage buffers.
+        VkDeviceSize min_alignment;
+
+        void init(VkDevice device, VmaAllocator allocator, VkDeviceSize capacity, const VkPhysicalDeviceLimits& limits);
+        void destroy(VmaAllocator allocator);
+
+        // Frees every allocation. The GPU must be done with the frame.
+        void reset();
+
+        FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+        template<typename T>
+        FrameAllocation push(const T& value)
+        {
+            // Aligning to the type lets shaders read it through a buffer reference with the same alignment.
+            FrameAllocation allocation = allocate(sizeof(T), alignof(T));
+            std::memcpy(allocation.pointer, &value, sizeof(T));
+            return allocation;
+        }
+
+        // Makes the writes visible to the GPU, if the memory isn't coherent. Call before submitting the frame.
+        void flush(VmaAllocator allocator);
+    };
+}
+
+#endif // CIORAN_FRAME_ALLOCATOR_H
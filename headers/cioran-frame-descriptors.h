@@ -0,0 +1,107 @@
+#ifndef CIORAN_FRAME_DESCRIPTORS_H
+#define CIORAN_FRAME_DESCRIPTORS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_mem_alloc.h"
+
+#include "cioran-bindless.h"
+#include "cioran-descriptor-buffer.h"
+#include "cioran-descriptors.h"
+#include "cioran-layout-cache.h"
+#include "cioran-settings.h"
+
+namespace cioran {
+    // The layout of a set that is filled for a single dispatch or draw, from a packed CPU struct.
+    //
+    // Each binding is a single descriptor, read from the struct at its offset: a VkDescriptorImageInfo for images,
+    // and a VkDescriptorBufferInfo for buffers. The same struct fills the set with every backend,
+    // so the code that builds the frame doesn't have to know where the set ends up.
+    //
+    // With the push backend, the set is pushed with a template, which belongs to the one set index of the one pipeline layout
+    // it was made for. So a layout is used by a single pipeline layout, and build_push_template() is called once that exists.
+    struct DispatchSetLayout {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        // Where each binding's descriptor is in the struct.
+        std::vector<VkDescriptorUpdateTemplateEntry> entries;
+        DescriptorBackend backend;
+        // Owned by the layout cache it was built with.
+        VkDescriptorSetLayout layout;
+        // Fills sets allocated from pools straight from the struct with the pool backend, and pushes them with the push backend.
+        // Not used by the buffer backend.
+        DescriptorUpdateTemplate update_template;
+
+        void add_binding(uint32_t binding, VkDescriptorType type, size_t offset);
+        // Gets the layout from the cache, with the flags the backend needs.
+        void build(VkDevice device, DescriptorLayoutCache& layout_cache, VkShaderStageFlags stage_flags, DescriptorBackend backend);
+        // Only does something with the push backend.
+        void build_push_template(VkDevice device, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index);
+        void destroy(VkDevice device);
+    };
+
+    // A set that was filled for one dispatch or draw. Which members are used depends on the backend.
+    struct DispatchSet {
+        VkDescriptorSet set;
+        DescriptorBufferSet buffer_set;
+        // A pushed set is only read from the struct when it's bound, so the struct has to live until the set's passes are recorded.
+        const DescriptorUpdateTemplate* push_template;
+        const void* data;
+    };
+
+    // The descriptor sets that only live for a frame, kept with the backend that was picked at startup.
+    //
+    // Sets are filled with write() while the frame is built, and bound with bind() while its passes are recorded.
+    // - pool: sets are allocated from a DescriptorAllocator, and filled from the struct with an update template.
+    // - buffer: sets are allocated from a DescriptorBufferAllocator, and the descriptors in the struct are copied into it.
+    // - push: nothing is allocated. bind() pushes the set from the struct into the command buffer with the layout's push template.
+    //   That costs a little recording time in every command buffer the set is bound in, but nothing has to be freed afterwards.
+    //
+    // Pipelines that read sets from descriptor buffers can't bind regular sets, so with the buffer backend the bindless heap
+    // lives in a descriptor buffer too. Only one list of descriptor buffers can be bound at a time, so bind_heap() binds
+    // the heap's buffer and the frame's buffer together, and has to come before bind() in every command buffer.
+    //
+    // Filling sets is not thread safe. Binding only reads, so passes can be recorded on several threads at once.
+    struct FrameDescriptors {
+        // The descriptor buffers bound by bind_heap(), in this order.
+        static constexpr uint32_t HEAP_BUFFER_INDEX { 0 };
+        static constexpr uint32_t FRAME_BUFFER_INDEX { 1 };
+
+        DescriptorBackend backend;
+        VkDevice device;
+        DescriptorAllocator pool;
+        DescriptorBufferAllocator buffer;
+        const PushDescriptorFunctions* push_functions;
+
+        // The push functions are only needed with the push backend.
+        void init(VkDevice device, VkPhysicalDevice physical_device, VmaAllocator allocator, DescriptorBackend backend,
+            std::span<const DescriptorAllocator::PoolSizeRatio> pool_ratios, const PushDescriptorFunctions* push_functions = nullptr);
+        void destroy(VmaAllocator allocator);
+
+        // Frees every set of the frame. The GPU must be done with all of them.
+        void reset();
+        // Makes the frame's descriptors visible to the GPU. Call before submitting the frame.
+        void flush(VmaAllocator allocator);
+
+        // Fills a set with the descriptors in data, the packed struct the layout describes.
+        // The push backend keeps the pointer instead of copying the descriptors, see DispatchSet.
+        DispatchSet write(const DispatchSetLayout& layout, const void* data);
+        template<typename T>
+        DispatchSet write(const DispatchSetLayout& layout, const T& data) { return write(layout, (const void*)&data); }
+
+        // Binds the bindless heap at set 0 of the pipeline layout.
+        void bind_heap(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, const BindlessHeap& heap) const;
+        void bind(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index, const DispatchSet& set) const;
+
+        void write_buffer_descriptor(const DescriptorBufferSet& set, const VkDescriptorUpdateTemplateEntry& entry, const uint8_t* data);
+    };
+
+    // Whether the device can bind the two descriptor buffers of the buffer backend at once, the bindless heap's and the frame's.
+    bool supports_frame_descriptor_buffers(VkPhysicalDevice physical_device);
+}
+
+#endif // CIORAN_FRAME_DESCRIPTORS_H
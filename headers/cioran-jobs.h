@@ -0,0 +1,118 @@
+#ifndef CIORAN_JOBS_H
+#define CIORAN_JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace cioran {
+    using Job = std::function<void()>;
+
+    // The state of a scheduled job, shared between the scheduler and everyone holding a handle to it.
+    struct JobState {
+        Job job;
+
+        // The job is queued once this reaches zero. It starts at the number of unfinished dependencies + 1,
+        // where the extra count is held by the scheduling thread until it has registered with all of the dependencies.
+        std::atomic<uint32_t> remaining_dependencies;
+
+        std::mutex mutex;
+        // Notified when the job finishes, for threads that block on it instead of running other jobs.
+        std::condition_variable finished_condition;
+        bool finished;
+        // Jobs that depend on this one. They are released when this job finishes.
+        std::vector<std::shared_ptr<JobState>> dependents;
+    };
+
+    using JobHandle = std::shared_ptr<JobState>;
+
+    // A work-stealing job system.
+    //
+    // Every thread in the job system has its own deque of jobs. A thread pushes and pops jobs at the back of its own deque,
+    // which is last in, first out, and keeps the data it just touched in its cache.
+    // When a thread runs out of jobs, it steals from the front of another thread's deque, which is where the oldest,
+    // and usually largest, pieces of work are.
+    // Each deque has its own lock, so threads only contend when they actually touch the same deque.
+    //
+    // Thread 0 is the thread that called init(), which takes part in the work whenever it waits for jobs.
+    // The other threads are worker threads, which sleep when there is no work.
+    struct JobSystem {
+        struct WorkerQueue {
+            std::mutex mutex;
+            std::deque<JobHandle> jobs;
+        };
+
+        std::vector<std::unique_ptr<WorkerQueue>> queues;
+        std::vector<std::thread> workers;
+
+        // Incremented whenever a job is queued, so sleeping workers can tell if they missed a wake up.
+        std::atomic<uint64_t> work_generation;
+        std::atomic<bool> stopping;
+        std::mutex sleep_mutex;
+        std::condition_variable sleep_condition;
+
+        // Used to spread jobs queued by threads outside of the job system.
+        std::atomic<uint32_t> next_queue;
+
+        // Starts the worker threads. 0 picks one worker per hardware thread, except the one the calling thread runs on.
+        void init(uint32_t worker_count);
+        void shutdown();
+
+        // The number of threads that run jobs, including the thread that called init().
+        uint32_t thread_count() const;
+
+        // The index of the calling thread in the job system, or -1 if it isn't one of its threads.
+        static int current_thread_index();
+
+        // Schedules a job to run once all of its dependencies have finished.
+        JobHandle schedule(Job job, std::span<const JobHandle> dependencies = {});
+
+        // Waits for a job to finish. Threads of the job system run other jobs while they wait,
+        // and block once there is nothing left for them to run. Other threads only block.
+        void wait(const JobHandle& handle);
+
+        // Runs fn(begin, end) over [0, count) in chunks of at most grain_size, and returns when all chunks are done.
+        // It's meant for work that is created and finished within a frame, like culling or command recording.
+        void parallel_for(uint32_t count, uint32_t grain_size, const std::function<void(uint32_t, uint32_t)>& fn);
+
+        void enqueue(JobHandle handle);
+        bool run_one(int thread_index);
+        void finish(const JobHandle& handle);
+        void worker_main(int thread_index);
+    };
+
+    // A dedicated thread that runs jobs one at a time, in the order they were scheduled.
+    //
+    // It's for slow work that has to stay off the frame, like rebuilding pipelines or writing files.
+    // That work can't go to the job system: the render thread is one of its threads, and runs whatever is
+    // queued whenever it waits for its own jobs, so a rebuild could end up running in the middle of recording a frame.
+    // Nothing but this thread runs its jobs, so scheduling work here never delays the caller.
+    struct BackgroundQueue {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<JobHandle> jobs;
+        bool stopping;
+
+        void init();
+        // Runs the jobs that are still queued, and stops the thread.
+        void shutdown();
+
+        JobHandle schedule(Job job);
+
+        // Blocks until the job has finished.
+        static void wait(const JobHandle& handle);
+        static bool is_finished(const JobHandle& handle);
+
+        void thread_main();
+    };
+}
+
+#endif // CIORAN_JOBS_H
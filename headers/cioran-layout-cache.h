@@ -0,0 +1,162 @@
+#ifndef CIORAN_LAYOUT_CACHE_H
+#define CIORAN_LAYOUT_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace cioran {
+    // The number of entries in a layout cache. Applications use a few hundred distinct layouts at most,
+    // and keeping the table at most half full keeps probe sequences short.
+    constexpr uint32_t LAYOUT_CACHE_CAPACITY { 4096 };
+
+    // A hash table of Vulkan objects, keyed by the description they were created from.
+    //
+    // Lookups don't lock. Every slot is an atomic pointer to an entry, which is published once, fully constructed,
+    // and never changed or removed until the cache is destroyed. A reader probes the slots from the key's hash
+    // until it finds the key or an empty slot, so it never sees a half written entry.
+    //
+    // Inserting takes a mutex, looks again in case another thread inserted the same key in the meantime,
+    // and only then creates the object, so each distinct key creates exactly one object.
+    // The table doesn't grow, so that readers never have to deal with it moving.
+    template<typename Key, typename Handle>
+    struct LayoutTable {
+        struct Entry {
+            uint64_t hash;
+            Key key;
+            Handle handle;
+        };
+
+        std::unique_ptr<std::atomic<Entry*>[]> slots;
+        std::mutex insert_mutex;
+        uint32_t count { 0 };
+
+        void init()
+        {
+            slots = std::make_unique<std::atomic<Entry*>[]>(LAYOUT_CACHE_CAPACITY);
+            for (uint32_t i = 0; i < LAYOUT_CACHE_CAPACITY; i++) {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+            count = 0;
+        }
+
+        Handle find(uint64_t hash, const Key& key) const
+        {
+            for (uint32_t probe = 0; probe < LAYOUT_CACHE_CAPACITY; probe++) {
+                const Entry* entry = slots[(hash + probe) & (LAYOUT_CACHE_CAPACITY - 1)].load(std::memory_order_acquire);
+                if (entry == nullptr) {
+                    return VK_NULL_HANDLE;
+                }
+                if (entry->hash == hash && entry->key == key) {
+                    return entry->handle;
+                }
+            }
+
+            return VK_NULL_HANDLE;
+        }
+
+        // Returns the handle for the key, calling create() to make it if the key isn't in the table yet.
+        template<typename Create>
+        Handle get_or_create(uint64_t hash, const Key& key, Create create)
+        {
+            Handle handle = find(hash, key);
+            if (handle != VK_NULL_HANDLE) {
+                return handle;
+            }
+
+            std::lock_guard<std::mutex> lock(insert_mutex);
+
+            handle = find(hash, key);
+            if (handle != VK_NULL_HANDLE) {
+                return handle;
+            }
+
+            if (count >= LAYOUT_CACHE_CAPACITY / 2) {
+                std::cout << "Layout cache is full" << std::endl;
+                std::terminate();
+            }
+
+            Entry* entry = new Entry { hash, key, create() };
+            for (uint32_t probe = 0; probe < LAYOUT_CACHE_CAPACITY; probe++) {
+                std::atomic<Entry*>& slot = slots[(hash + probe) & (LAYOUT_CACHE_CAPACITY - 1)];
+                if (slot.load(std::memory_order_relaxed) == nullptr) {
+                    slot.store(entry, std::memory_order_release);
+                    break;
+                }
+            }
+            count++;
+
+            return entry->handle;
+        }
+
+        // Calls destroy() for every handle, and empties the table. No other thread may use the table anymore.
+        template<typename Destroy>
+        void destroy(Destroy destroy)
+        {
+            for (uint32_t i = 0; i < LAYOUT_CACHE_CAPACITY; i++) {
+                Entry* entry = slots[i].load(std::memory_order_relaxed);
+                if (entry != nullptr) {
+                    destroy(entry->handle);
+                    delete entry;
+                }
+            }
+
+            slots.reset();
+            count = 0;
+        }
+    };
+
+    struct DescriptorLayoutKey {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlags> binding_flags;
+        VkDescriptorSetLayoutCreateFlags flags;
+
+        bool operator==(const DescriptorLayoutKey& other) const;
+        uint64_t hash() const;
+    };
+
+    struct PipelineLayoutKey {
+        std::vector<VkDescriptorSetLayout> set_layouts;
+        std::vector<VkPushConstantRange> push_constant_ranges;
+
+        bool operator==(const PipelineLayoutKey& other) const;
+        uint64_t hash() const;
+    };
+
+    // Hands out one VkDescriptorSetLayout per distinct set of bindings, stage flags and create flags.
+    // Identical layouts get identical handles, so descriptor sets are compatible between every pipeline built from them.
+    // The cache owns the layouts. They live until the cache is destroyed.
+    struct DescriptorLayoutCache {
+        VkDevice device;
+        LayoutTable<DescriptorLayoutKey, VkDescriptorSetLayout> table;
+
+        void init(VkDevice device);
+        void destroy();
+
+        // The stage flags are added to every binding, like DescriptorLayoutBuilder::build() does.
+        // The binding flags are optional, and if given, there is one for each binding.
+        // Immutable samplers are not supported.
+        VkDescriptorSetLayout get(std::span<const VkDescriptorSetLayoutBinding> bindings, VkShaderStageFlags stage_flags,
+            VkDescriptorSetLayoutCreateFlags flags = 0, std::span<const VkDescriptorBindingFlags> binding_flags = {});
+    };
+
+    // Hands out one VkPipelineLayout per distinct list of set layouts and push constant ranges.
+    // Since identical descriptor set layouts already share a handle, comparing the handles is enough.
+    struct PipelineLayoutCache {
+        VkDevice device;
+        LayoutTable<PipelineLayoutKey, VkPipelineLayout> table;
+
+        void init(VkDevice device);
+        void destroy();
+
+        VkPipelineLayout get(std::span<const VkDescriptorSetLayout> set_layouts, std::span<const VkPushConstantRange> push_constant_ranges);
+    };
+}
+
+#endif // CIORAN_LAYOUT_CACHE_H
@@ -0,0 +1,52 @@
+#ifndef CIORAN_MAILBOX_H
+#define CIORAN_MAILBOX_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace cioran {
+    // A lock-free mailbox that hands the latest value from one producer thread to one consumer thread.
+    //
+    // It's a triple buffer: the producer writes into its own slot, and then swaps it with the shared middle slot.
+    // The consumer swaps its own slot with the middle slot when a new value has been published.
+    // Neither side ever waits for the other, and the consumer always gets the most recent complete value.
+    // Values that are published faster than they are consumed are overwritten, so a mailbox carries state, not events.
+    template <typename T>
+    struct Mailbox {
+        // The low bits of the state are the index of the middle slot, the dirty bit is set when the middle slot holds a value
+        // the consumer hasn't seen yet.
+        static constexpr uint32_t INDEX_MASK { 0x3 };
+        static constexpr uint32_t DIRTY_BIT { 0x4 };
+
+        T slots[3] {};
+        std::atomic<uint32_t> middle { 1 };
+        uint32_t producer_index { 0 };
+        uint32_t consumer_index { 2 };
+
+        // Producer side: publishes a new value.
+        void publish(const T& value)
+        {
+            slots[producer_index] = value;
+
+            // Release makes the write to our slot visible to the consumer once it acquires the slot.
+            uint32_t previous = middle.exchange(producer_index | DIRTY_BIT, std::memory_order_acq_rel);
+            producer_index = previous & INDEX_MASK;
+        }
+
+        // Consumer side: returns true and updates the value if a new one has been published since the last call.
+        bool try_receive(T& value)
+        {
+            if ((middle.load(std::memory_order_relaxed) & DIRTY_BIT) == 0) {
+                return false;
+            }
+
+            uint32_t previous = middle.exchange(consumer_index, std::memory_order_acq_rel);
+            consumer_index = previous & INDEX_MASK;
+            value = slots[consumer_index];
+
+            return true;
+        }
+    };
+}
+
+#endif // CIORAN_MAILBOX_H
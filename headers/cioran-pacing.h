@@ -0,0 +1,78 @@
+#ifndef CIORAN_PACING_H
+#define CIORAN_PACING_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace cioran {
+    // Sleeps until the given point in time.
+    // OS sleeps are only accurate to around a millisecond, so we sleep until we are close to the deadline,
+    // and then spin (yielding the thread) for the last part.
+    void precise_sleep_until(std::chrono::steady_clock::time_point deadline);
+
+    // The frame pacer decides when the CPU should start working on a frame.
+    //
+    // Without pacing, the CPU starts a new frame as soon as the GPU and the swapchain lets it.
+    // With vsync, that means the frame sits in the present queue waiting for scanout, and the input it was
+    // built from gets older while it waits.
+    //
+    // With VK_KHR_present_id and VK_KHR_present_wait, each present gets an id, and we can wait for the
+    // presentation engine to actually display a given id. The pacer uses that to:
+    // 1. Allow at most one frame to be queued for presentation.
+    // 2. Delay the start of the next frame, so it finishes just before the vblank it is displayed at ("just in time").
+    //    The delay is adjusted continuously: it grows slowly while frames make their vblank, and backs off quickly when one is missed.
+    // 3. Measure the latency from the start of a frame (where input is sampled) to when it's displayed.
+    //
+    // Independently of present wait, a frame rate limiter can cap the frame rate with a high precision sleep.
+    struct FramePacer {
+        using Clock = std::chrono::steady_clock;
+
+        // How many frame start times we remember, to match them up with present ids when they are displayed.
+        static constexpr uint32_t HISTORY_SIZE { 16 };
+
+        // Null if present wait is not supported or enabled.
+        PFN_vkWaitForPresentKHR wait_for_present;
+        bool just_in_time;
+
+        Clock::duration limiter_interval;
+        Clock::duration refresh_interval;
+        Clock::duration start_delay;
+
+        // The id of the last present. Ids start at 1, 0 means nothing has been presented yet.
+        uint64_t present_id;
+        // Present ids are per swapchain. We must not wait for ids that were presented to a previous swapchain.
+        uint64_t first_swapchain_present_id;
+
+        uint64_t last_displayed_id;
+        Clock::time_point last_display_time;
+        Clock::time_point last_frame_start;
+        std::array<Clock::time_point, HISTORY_SIZE> frame_starts;
+
+        // The latency of the last frame we saw displayed, from the start of its CPU work until it reached the screen.
+        double latency_ms;
+        // The id latency_ms was last handed out for, so each displayed frame is only sampled once.
+        uint64_t last_sampled_id;
+        uint32_t missed_frames;
+
+        void init(VkDevice device, bool present_wait_enabled, bool enable_just_in_time, uint32_t fps_limit, float refresh_rate_hz);
+        void on_swapchain_recreated();
+
+        // Blocks until the CPU should start working on the next frame.
+        void wait_for_frame_start(VkDevice device, VkSwapchainKHR swapchain);
+
+        // Marks the start of the CPU work for a frame, and returns the present id to present it with.
+        uint64_t begin_frame();
+
+        // The structure to chain into VkPresentInfoKHR. The id pointer has to stay valid until the present call.
+        VkPresentIdKHR present_id_info(const uint64_t* id) const;
+
+        // Returns the latency of the frame displayed last, if it hasn't been returned before.
+        // Frames aren't always seen displayed (the wait can time out), so there isn't a sample for every frame.
+        bool take_latency_sample(double& sample_ms);
+    };
+}
+
+#endif // CIORAN_PACING_H
@@ -0,0 +1,77 @@
+#ifndef CIORAN_PIPELINE_CACHE_H
+#define CIORAN_PIPELINE_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "cioran-jobs.h"
+
+namespace cioran {
+    constexpr const char* DEFAULT_PIPELINE_CACHE_PATH { "cioran-pipeline-cache.bin" };
+
+    // How often the cache is written to disk while running, if pipelines were added to it since the last save.
+    constexpr std::chrono::seconds PIPELINE_CACHE_SAVE_INTERVAL { 30 };
+
+    // The header we put in front of the driver's cache data.
+    // The driver validates its own data too, but a driver that is handed data from another device or driver version
+    // is allowed to do anything from ignoring it to crashing, so we only hand it data we know it wrote itself.
+    struct PipelineCacheFileHeader {
+        uint32_t magic;
+        uint32_t file_version;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+        uint64_t data_size;
+        // A checksum of the data, which catches files that were cut short or damaged on disk.
+        uint64_t data_checksum;
+    };
+
+    constexpr uint32_t PIPELINE_CACHE_MAGIC { 0x48435043 }; // "CPCH"
+    constexpr uint32_t PIPELINE_CACHE_FILE_VERSION { 1 };
+
+    // A VkPipelineCache that persists across runs.
+    //
+    // Creating a pipeline compiles its shaders to the GPU's instruction set, which is by far the slowest part of startup.
+    // The pipeline cache keeps the compiled results, so with a warm cache creating the same pipeline again is close to free.
+    //
+    // The cache is loaded when it's created, and saved when it's destroyed and periodically in between.
+    // Files are written to a temporary file first, which is then renamed over the old one.
+    // The rename replaces the file in one step, so a crash while saving leaves the previous cache intact.
+    struct PipelineCache {
+        VkDevice device;
+        VkPipelineCache cache;
+        std::string path;
+
+        VkPhysicalDeviceProperties properties;
+
+        // The size of the driver's data at the last save. If it hasn't changed, no pipelines were added and there is nothing to save.
+        size_t saved_data_size;
+        std::chrono::steady_clock::time_point last_save_time;
+        // The periodic save in progress on the background queue, if any.
+        JobHandle save_job;
+
+        void init(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path = DEFAULT_PIPELINE_CACHE_PATH);
+        // Saves the cache one last time, and destroys it. Any periodic save must have finished.
+        void destroy();
+
+        // Writes the cache to disk, if it changed since it was last written. Returns false if writing failed.
+        bool save();
+
+        // Saves the cache on the background queue, if the save interval has passed since the last save.
+        // Called every frame from the render thread. The save runs on another thread, so it never stalls the frame.
+        void save_periodically(BackgroundQueue& background);
+        // Waits for a periodic save that is still running. Has to be called before the background queue is shut down.
+        void wait_for_save();
+
+        // Reads the cache file, and returns the driver's data if the file is valid for this device and driver.
+        bool load_file(std::vector<char>& data);
+    };
+}
+
+#endif // CIORAN_PIPELINE_CACHE_H
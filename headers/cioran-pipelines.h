@@ -0,0 +1,135 @@
+#ifndef CIORAN_PIPELINES_H
+#define CIORAN_PIPELINES_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "cioran-layout-cache.h"
+
+// The directory the compiled shaders are loaded from. CMake compiles the shaders into the build directory, and points this at them.
+#ifndef CIORAN_SHADER_DIR
+#define CIORAN_SHADER_DIR "shaders"
+#endif
+
+namespace cioran {
+    // Loads a compiled SPIR-V file into a shader module. Returns false if the file can't be read or the module can't be created,
+    // so a broken shader doesn't have to take down the renderer.
+    bool load_shader_module(VkDevice device, const char* file_path, VkShaderModule* out_shader_module);
+
+    // The properties of a device that decide how compute kernels should be shaped to run well on it.
+    struct ComputeDeviceInfo {
+        uint32_t vendor_id;
+        VkPhysicalDeviceType device_type;
+        // The number of invocations the device runs in lockstep: a warp, a wavefront, or the SIMD width on a CPU.
+        uint32_t subgroup_size;
+        uint32_t max_workgroup_size[3];
+        uint32_t max_workgroup_invocations;
+    };
+
+    ComputeDeviceInfo query_compute_device_info(VkPhysicalDevice physical_device);
+
+    struct WorkgroupSize {
+        uint32_t x;
+        uint32_t y;
+    };
+
+    // Picks the workgroup size of 2D image kernels for the device, from a tuning table of known vendors,
+    // or from the subgroup size for devices that aren't in it.
+    WorkgroupSize choose_workgroup_size_2d(const ComputeDeviceInfo& device);
+
+    // The specialization constants of a shader, all of them 32-bit.
+    // Specialization constants are fixed when the pipeline is created, so the driver compiles the shader as if they were literals.
+    // That makes them free at runtime, unlike push constants, and lets them size things that must be known at compile time, like workgroups.
+    struct SpecializationConstants {
+        std::vector<VkSpecializationMapEntry> entries;
+        std::vector<uint32_t> values;
+
+        // Sets the value of the constant with the given constant_id.
+        void set(uint32_t constant_id, uint32_t value);
+        // The returned info points into this struct, so it is only valid while the constants are unchanged.
+        VkSpecializationInfo info() const;
+    };
+
+    // The constant ids that kernels use for their workgroup size, as in layout(local_size_x_id = 0, local_size_y_id = 1) in;
+    constexpr uint32_t WORKGROUP_SIZE_X_CONSTANT_ID { 0 };
+    constexpr uint32_t WORKGROUP_SIZE_Y_CONSTANT_ID { 1 };
+
+    // Generic parameters for compute effects. What each vector means is up to the effect's shader.
+    // They are written into the frame allocator every time the effect is dispatched, and the shader reads them through
+    // a buffer reference, so they can grow past what fits into push constants.
+    // The alignment matches buffer_reference_align = 16 in the shaders.
+    struct alignas(16) ComputeParameters {
+        float data1[4];
+        float data2[4];
+        float data3[4];
+        float data4[4];
+    };
+
+    // The push constants of compute effects, pushed every time the effect is dispatched.
+    // 128 bytes is the minimum push constant size every device has to support, and this stays well below it.
+    struct ComputePushConstants {
+        // Indices into the bindless heap of the resources the effect uses. By convention the first one is the image it writes.
+        uint32_t indices[4];
+        // The device address of the effect's ComputeParameters for this dispatch.
+        VkDeviceAddress parameters;
+    };
+
+    // Builds the pipeline layout and pipeline of a compute shader.
+    // The layout is made from descriptor set layouts, for example from a DescriptorLayoutBuilder, and push constant ranges.
+    struct ComputePipelineBuilder {
+        std::vector<VkDescriptorSetLayout> set_layouts;
+        std::vector<VkPushConstantRange> push_constant_ranges;
+
+        // Set layouts are numbered in the order they are added, starting at set 0.
+        void add_set_layout(VkDescriptorSetLayout layout);
+        void add_push_constant_range(uint32_t size, uint32_t offset = 0);
+        void clear();
+
+        VkPipelineLayout build_layout(VkDevice device);
+        // Gets the layout from the cache instead, which owns it. Effects with the same sets and push constants share one layout.
+        VkPipelineLayout build_layout(PipelineLayoutCache& layout_cache);
+        VkPipeline build_pipeline(VkDevice device, VkPipelineLayout layout, VkShaderModule shader_module, VkPipelineCache pipeline_cache = VK_NULL_HANDLE);
+    };
+
+    // Creates a compute pipeline. Returns false on failure instead of terminating, for pipelines that are rebuilt while running.
+    // Pipelines that read their sets from a descriptor buffer need VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT in the flags.
+    bool create_compute_pipeline(VkDevice device, VkPipelineLayout layout, VkShaderModule shader_module, VkPipelineCache pipeline_cache, VkPipeline* out_pipeline,
+        const VkSpecializationInfo* specialization = nullptr, VkPipelineCreateFlags flags = 0);
+
+    // A compute shader that runs over a whole image, with the push constants it is dispatched with.
+    // The push constants, and the parameters they point to, can be changed every frame without touching any descriptors.
+    struct ComputeEffect {
+        const char* name;
+        // The compiled shader, relative to the shader directory.
+        const char* shader_file;
+        VkPipeline pipeline;
+        // Usually shared with other effects through a PipelineLayoutCache, so the effect doesn't own it.
+        VkPipelineLayout layout;
+        // The workgroup size of the shader, which the dispatch size is derived from.
+        // It's passed to the shader as specialization constants, along with any other constants in specialization.
+        uint32_t workgroup_size_x;
+        uint32_t workgroup_size_y;
+        SpecializationConstants specialization;
+        // Flags the pipeline is created with, like VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT when its sets come from descriptor buffers.
+        // Rebuilt pipelines get the same flags.
+        VkPipelineCreateFlags pipeline_flags;
+        ComputePushConstants data;
+
+        // Sets the workgroup size, and the specialization constants the shader takes it from.
+        void set_workgroup_size(WorkgroupSize size);
+
+        // Loads the effect's shader and creates a pipeline for it with the effect's layout. The effect itself is left untouched.
+        // Returns false if the shader can't be loaded or the pipeline can't be created.
+        bool build_pipeline(VkDevice device, VkPipelineCache pipeline_cache, VkPipeline* out_pipeline) const;
+
+        // Binds the effect, pushes its parameters and dispatches enough workgroups to cover the extent.
+        // The effect's descriptor sets have to be bound first, usually the bindless heap at set 0. How depends on the descriptor backend, see FrameDescriptors.
+        void dispatch(VkCommandBuffer cmd, VkExtent2D extent) const;
+        // Destroys the pipeline. The layout is left to whoever created it.
+        void destroy(VkDevice device);
+    };
+}
+
+#endif // CIORAN_PIPELINES_H
@@ -0,0 +1,204 @@
+#ifndef CIORAN_RENDER_GRAPH_H
+#define CIORAN_RENDER_GRAPH_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_mem_alloc.h"
+
+#include "cioran-barriers.h"
+#include "cioran-commands.h"
+#include "cioran-deferred.h"
+#include "cioran-jobs.h"
+#include "cioran-vulkan.h"
+
+namespace cioran {
+    // Handles to the resources used in a render graph. They are only valid for the frame they were created in.
+    struct GraphImage {
+        uint32_t index;
+    };
+
+    struct GraphBuffer {
+        uint32_t index;
+    };
+
+    // Describes an image that only lives within the frame, and is owned by the graph.
+    struct TransientImageInfo {
+        VkFormat format;
+        VkExtent3D extent;
+        VkImageUsageFlags usage;
+
+        bool operator==(const TransientImageInfo& other) const;
+    };
+
+    struct ImageAccess {
+        GraphImage image;
+        ImageUsage usage;
+        bool writes;
+        // The pass overwrites the whole image, so whatever was in it before doesn't matter.
+        bool discard;
+    };
+
+    struct BufferAccess {
+        GraphBuffer buffer;
+        BufferUsage usage;
+        bool writes;
+        bool discard;
+    };
+
+    // The queue a pass would like to run on.
+    // Async compute passes run on the dedicated compute queue if there is one, in parallel with the graphics queue.
+    enum class PassQueue {
+        graphics,
+        async_compute
+    };
+
+    // A pass declares which resources it reads and writes, and records its commands once the graph is compiled.
+    // A pass should only declare each resource once. If it both reads and writes a resource, declare it as a write without discard.
+    struct RenderGraphPass {
+        const char* name;
+        std::vector<ImageAccess> image_accesses;
+        std::vector<BufferAccess> buffer_accesses;
+        RecordTask record;
+        PassQueue queue;
+
+        // Filled in when the graph is compiled.
+        bool live;
+        // Whether the pass ended up on the compute queue. Async compute passes fall back to the graphics queue when they can't run ahead of it.
+        bool on_compute_queue;
+        BarrierBatch barriers;
+
+        void read(GraphImage image, ImageUsage usage);
+        void write(GraphImage image, ImageUsage usage, bool discard = false);
+        void read(GraphBuffer buffer, BufferUsage usage);
+        void write(GraphBuffer buffer, BufferUsage usage, bool discard = false);
+    };
+
+    // A render graph describes a frame as a list of passes and the resources they use.
+    //
+    // The graph is rebuilt every frame. Compiling it does the work that otherwise has to be done by hand:
+    // - Passes that don't contribute to an output are culled.
+    // - Barriers are placed in front of each pass, from the tracked state of each resource and how the pass uses it.
+    // - Transient images get memory, and images whose lifetimes within the frame don't overlap share the same memory.
+    //
+    // A pass can only depend on passes declared before it, so the declaration order is always a valid order to run the passes in.
+    //
+    // With a dedicated compute queue, the passes run on the compute queue are submitted as their own batch, before the graphics batch.
+    // An async compute pass therefore can't depend on graphics work from the same frame.
+    // It falls back to the graphics queue if it uses a resource a graphics pass used earlier in the frame,
+    // or needs the contents of a resource that the graphics queue owns.
+    // Resources moving from the compute queue to the graphics queue get a queue family ownership transfer,
+    // and the graphics batch waits on the compute batch at the stages that use them.
+    //
+    // Transient images are kept between frames, and are only recreated when the transient images declared by the frame change.
+    struct RenderGraph {
+        struct ImageResource {
+            VkImage image;
+            VkImageView image_view;
+            // Imported images point to the state tracked by their owner, transient images to their own state.
+            ImageState* state;
+            // Index into the transient images declared this frame, or UINT32_MAX for imported images.
+            uint32_t transient_index;
+            bool output;
+            bool has_final_usage;
+            ImageUsage final_usage;
+        };
+
+        struct BufferResource {
+            VkBuffer buffer;
+            BufferState* state;
+            bool output;
+        };
+
+        // A transient image and the memory slot it was placed in.
+        struct TransientImage {
+            TransientImageInfo info;
+            // The first and last live pass that uses the image. first_pass is UINT32_MAX if no live pass uses it.
+            uint32_t first_pass;
+            uint32_t last_pass;
+
+            VkImage image;
+            VkImageView image_view;
+            ImageState state;
+            uint32_t slot;
+        };
+
+        // A piece of memory shared by transient images with lifetimes that don't overlap.
+        struct AliasSlot {
+            VkMemoryRequirements requirements;
+            VmaAllocation allocation;
+            // The state the memory was left in by the last image that used it.
+            // The next image placed in the slot has to wait for it, even though it is a different image.
+            ImageState last_state;
+        };
+
+        VkDevice device;
+        VmaAllocator allocator;
+        uint32_t graphics_queue_family;
+        // The same as the graphics queue family when there is no dedicated compute queue.
+        uint32_t compute_queue_family;
+
+        // A deque, so references to passes stay valid when more passes are added.
+        std::deque<RenderGraphPass> passes;
+        std::vector<ImageResource> images;
+        std::vector<BufferResource> buffers;
+        // The transient images declared this frame, and the ones currently allocated.
+        std::vector<TransientImageInfo> transient_infos;
+        std::vector<TransientImage> transient_images;
+        std::vector<AliasSlot> alias_slots;
+
+        // Transitions of the outputs into their final use, recorded after the last graphics pass.
+        BarrierBatch final_barriers;
+        // Releases of resources from the compute queue to the graphics queue, recorded after the last compute pass.
+        BarrierBatch release_barriers;
+
+        // The stages at which the graphics batch has to wait for the compute batch of the frame,
+        // and at which the compute batch has to wait for the graphics batch of the previous frame. NONE if no wait is needed.
+        VkPipelineStageFlags2 graphics_wait_stage;
+        VkPipelineStageFlags2 compute_wait_stage;
+
+        void init(VkDevice device, VmaAllocator allocator, uint32_t graphics_queue_family, uint32_t compute_queue_family);
+        void destroy();
+
+        // Starts a new frame. Passes and imported resources are forgotten, transient images are kept for reuse.
+        void reset();
+
+        // Imported resources are owned outside of the graph, which tracks their state through the given reference.
+        GraphImage import_image(VkImage image, VkImageView image_view, ImageState& state);
+        GraphBuffer import_buffer(VkBuffer buffer, BufferState& state);
+        GraphImage create_image(const TransientImageInfo& info);
+
+        // Passes writing to outputs are never culled.
+        void mark_output(GraphImage image);
+        // The image is transitioned into the final usage once all passes are done, for example to present it.
+        void mark_output(GraphImage image, ImageUsage final_usage);
+        void mark_output(GraphBuffer buffer);
+
+        RenderGraphPass& add_pass(const char* name);
+
+        // Culls passes, places transient images in memory and resolves the barriers of every pass.
+        // Transient images that are no longer needed are retired, since frames in flight might still use them.
+        void compile(DeferredDestroyer& destroyer);
+
+        // Whether any live pass runs on the compute queue, which means the compute batch has to be recorded and submitted.
+        bool has_compute_work() const;
+
+        // Records the live passes of one queue in parallel into secondary command buffers, and executes them from the primary command buffer.
+        // The command buffers have to be from a pool of that queue's family.
+        void execute(PassQueue queue, VkDevice device, VkCommandBuffer primary, FrameCommands& commands, JobSystem& jobs);
+
+        VkImage get_image(GraphImage image) const;
+        VkImageView get_image_view(GraphImage image) const;
+        VkBuffer get_buffer(GraphBuffer buffer) const;
+
+        void cull_passes();
+        void allocate_transient_images(DeferredDestroyer& destroyer);
+        void resolve_barriers();
+        bool can_run_async(uint32_t pass_index, const std::vector<bool>& image_used_on_graphics, const std::vector<bool>& buffer_used_on_graphics) const;
+    };
+}
+
+#endif // CIORAN_RENDER_GRAPH_H
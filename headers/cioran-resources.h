@@ -0,0 +1,251 @@
+#ifndef CIORAN_RESOURCES_H
+#define CIORAN_RESOURCES_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_mem_alloc.h"
+
+#include "cioran-bindless.h"
+#include "cioran-deferred.h"
+#include "cioran-vulkan.h"
+
+namespace cioran {
+    // A handle packs a slot index into the low 20 bits and the slot's generation into the high 12 bits.
+    // That allows for about a million resources of each kind, and catches a stale handle unless its slot was reused 4096 times since.
+    constexpr uint32_t HANDLE_INDEX_BITS { 20 };
+    constexpr uint32_t HANDLE_INDEX_MASK { (1u << HANDLE_INDEX_BITS) - 1 };
+    constexpr uint32_t HANDLE_GENERATION_MASK { (1u << (32 - HANDLE_INDEX_BITS)) - 1 };
+    constexpr uint32_t MAX_RESOURCE_SLOTS { 1u << HANDLE_INDEX_BITS };
+
+    // A 32-bit generational handle to a resource in a ResourcePool.
+    // Generations start at 1, so a handle of 0 is never valid and can be used as null.
+    // The index of a handle is stable for the lifetime of the resource, so it doubles as the resource's index in bindless descriptor arrays.
+    template<typename Tag>
+    struct ResourceHandle {
+        uint32_t value { 0 };
+
+        uint32_t index() const { return value & HANDLE_INDEX_MASK; }
+        uint32_t generation() const { return value >> HANDLE_INDEX_BITS; }
+        bool is_null() const { return value == 0; }
+
+        bool operator==(const ResourceHandle& other) const { return value == other.value; }
+        bool operator!=(const ResourceHandle& other) const { return value != other.value; }
+    };
+
+    struct ImageTag {};
+    struct BufferTag {};
+    struct ImageViewTag {};
+
+    using ImageHandle = ResourceHandle<ImageTag>;
+    using BufferHandle = ResourceHandle<BufferTag>;
+    using ImageViewHandle = ResourceHandle<ImageViewTag>;
+
+    // An additional view of an image in the registry, for example of a single mip level.
+    // The image's default view lives in the image itself.
+    struct ImageViewResource {
+        VkImageView view;
+        ImageHandle image;
+    };
+
+    // Stores resources of one kind in a dense, fixed size array of slots.
+    //
+    // The arrays are allocated once in init(), so resources never move and lookups never chase pointers:
+    // a lookup is one generation compare and one array index. Since nothing is ever reallocated,
+    // lookups need no lock, only creating and releasing slots does.
+    //
+    // Releasing a slot bumps its generation right away, so stale handles are caught from then on.
+    // The slot itself is only reused once the GPU has finished the epoch it was released in,
+    // because frames in flight can still reach the slot through its bindless descriptor index.
+    template<typename T, typename Tag>
+    struct ResourcePool {
+        using Handle = ResourceHandle<Tag>;
+
+        struct RetiredSlot {
+            uint32_t index;
+            uint64_t epoch;
+        };
+
+        std::unique_ptr<T[]> slots;
+        // The generations are kept apart from the slots, so validating a handle touches as little memory as possible.
+        std::unique_ptr<std::atomic<uint32_t>[]> generations;
+        uint32_t capacity { 0 };
+
+        // Guards everything below.
+        std::mutex mutex;
+        // Slots below this have been handed out before. Slots from here on have never been used.
+        uint32_t used_count { 0 };
+        std::vector<uint32_t> free_indices;
+        std::deque<RetiredSlot> retired_slots;
+
+        void init(uint32_t capacity)
+        {
+            if (capacity > MAX_RESOURCE_SLOTS) {
+                std::cout << "Resource pool capacity " << capacity << " exceeds the handle index range" << std::endl;
+                std::terminate();
+            }
+
+            this->capacity = capacity;
+            slots = std::make_unique<T[]>(capacity);
+            generations = std::make_unique<std::atomic<uint32_t>[]>(capacity);
+            for (uint32_t i = 0; i < capacity; i++) {
+                generations[i].store(1, std::memory_order_relaxed);
+            }
+
+            used_count = 0;
+            free_indices.clear();
+            retired_slots.clear();
+        }
+
+        void destroy()
+        {
+            slots.reset();
+            generations.reset();
+            capacity = 0;
+        }
+
+        // Stores the resource in a free slot. Lower indices are preferred, which keeps the bindless arrays compact.
+        Handle allocate(const T& resource)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            uint32_t index;
+            if (!free_indices.empty()) {
+                index = free_indices.back();
+                free_indices.pop_back();
+            } else if (used_count < capacity) {
+                index = used_count++;
+            } else {
+                std::cout << "Resource pool is full, all " << capacity << " slots are in use" << std::endl;
+                std::terminate();
+            }
+
+            slots[index] = resource;
+
+            uint32_t generation = generations[index].load(std::memory_order_relaxed);
+            return Handle { (generation << HANDLE_INDEX_BITS) | index };
+        }
+
+        // Invalidates the handle. The slot is reused once reclaim() is called with an epoch at or after the given one.
+        void release(Handle handle, uint64_t epoch)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            uint32_t index = handle.index();
+            uint32_t next_generation = (handle.generation() + 1) & HANDLE_GENERATION_MASK;
+            if (next_generation == 0) {
+                next_generation = 1;
+            }
+
+            generations[index].store(next_generation, std::memory_order_release);
+            slots[index] = T {};
+            retired_slots.push_back({ index, epoch });
+        }
+
+        // Makes the slots released in the given epoch or before it available again.
+        void reclaim(uint64_t completed_epoch)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            while (!retired_slots.empty() && retired_slots.front().epoch <= completed_epoch) {
+                free_indices.push_back(retired_slots.front().index);
+                retired_slots.pop_front();
+            }
+        }
+
+        bool is_valid(Handle handle) const
+        {
+            return !handle.is_null()
+                && handle.index() < capacity
+                && generations[handle.index()].load(std::memory_order_acquire) == handle.generation();
+        }
+
+        T& get(Handle handle)
+        {
+            if (!is_valid(handle)) {
+                std::cout << "Used a stale or invalid resource handle, index " << handle.index() << " generation " << handle.generation() << std::endl;
+                std::terminate();
+            }
+
+            return slots[handle.index()];
+        }
+
+        // Calls the function with every resource that is still alive.
+        template<typename Function>
+        void for_each_alive(Function function)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            std::vector<bool> dead(used_count, false);
+            for (uint32_t index : free_indices) {
+                dead[index] = true;
+            }
+            for (const RetiredSlot& retired : retired_slots) {
+                dead[retired.index] = true;
+            }
+
+            for (uint32_t i = 0; i < used_count; i++) {
+                if (!dead[i]) {
+                    function(slots[i]);
+                }
+            }
+        }
+    };
+
+    // The default number of slots of each kind. Each is capped by the size of the bindless heap's arrays, so every index has a descriptor.
+    constexpr uint32_t DEFAULT_IMAGE_SLOTS { 16384 };
+    constexpr uint32_t DEFAULT_BUFFER_SLOTS { 16384 };
+    constexpr uint32_t DEFAULT_IMAGE_VIEW_SLOTS { 16384 };
+
+    // Owns the long lived GPU resources, and hands them out as generational handles instead of passing the resources around by value.
+    //
+    // Resources are created and destroyed from any thread. Destroying a resource retires its Vulkan objects
+    // to the deferred destroyer, so it is safe while frames in flight still use it.
+    // The registry's epochs are the deferred destroyer's, and reclaim() has to be called alongside its collect().
+    //
+    // With a bindless heap, every storage or sampled image and every storage buffer gets a descriptor at the index of its handle.
+    // The descriptor of a destroyed resource is left as it is, since the slot isn't reused until no frame can read it anymore.
+    struct ResourceRegistry {
+        VkDevice device;
+        VmaAllocator allocator;
+        DeferredDestroyer* destroyer;
+        BindlessHeap* bindless;
+
+        ResourcePool<AllocatedImage, ImageTag> images;
+        ResourcePool<AllocatedBuffer, BufferTag> buffers;
+        ResourcePool<ImageViewResource, ImageViewTag> image_views;
+
+        // The bindless heap is optional. When given, the slot counts are capped to the size of its arrays.
+        void init(VkDevice device, VmaAllocator allocator, DeferredDestroyer& destroyer, BindlessHeap* bindless = nullptr,
+            uint32_t image_slots = DEFAULT_IMAGE_SLOTS, uint32_t buffer_slots = DEFAULT_BUFFER_SLOTS, uint32_t image_view_slots = DEFAULT_IMAGE_VIEW_SLOTS);
+        // Destroys every resource that is still alive. The GPU must be idle.
+        void destroy();
+
+        // Creates a 2D image in device local memory, with a default view of the whole image.
+        ImageHandle create_image(VkFormat format, VkExtent3D extent, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+        // Creates a buffer. See create_buffer() for the memory usage and flags.
+        BufferHandle create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memory_usage, VmaAllocationCreateFlags allocation_flags = 0);
+        // Creates an additional view of an image. The image field of the create info is filled in from the handle.
+        ImageViewHandle create_image_view(ImageHandle image, VkImageViewCreateInfo view_info);
+
+        void destroy_image(ImageHandle image);
+        void destroy_buffer(BufferHandle buffer);
+        void destroy_image_view(ImageViewHandle image_view);
+
+        AllocatedImage& get(ImageHandle image) { return images.get(image); }
+        AllocatedBuffer& get(BufferHandle buffer) { return buffers.get(buffer); }
+        ImageViewResource& get(ImageViewHandle image_view) { return image_views.get(image_view); }
+
+        // Makes the slots of resources destroyed in the given epoch or before it available again.
+        void reclaim(uint64_t completed_epoch);
+    };
+}
+
+#endif // CIORAN_RESOURCES_H
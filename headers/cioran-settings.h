@@ -0,0 +1,102 @@
+#ifndef CIORAN_SETTINGS_H
+#define CIORAN_SETTINGS_H
+
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "cioran-thread.h"
+
+namespace cioran {
+    // The latency mode trades input-to-photon latency against throughput.
+    // - low_latency: a single frame in flight, and input is sampled after waiting for the GPU, right before recording.
+    // - balanced: two frames in flight, which is the classic double buffered setup.
+    // - max_throughput: three or more frames in flight, so the CPU can run ahead of the GPU and is never stalled waiting for it.
+    enum class LatencyMode {
+        low_latency,
+        balanced,
+        max_throughput
+    };
+
+    // Where the descriptor sets that only live for a frame are kept.
+    // - pool: sets are allocated from descriptor pools and written with vkUpdateDescriptorSets.
+    // - buffer: descriptors are written straight into a buffer with VK_EXT_descriptor_buffer, and bound by offset.
+    //   Such pipelines can't bind regular sets, so the bindless heap moves into a descriptor buffer as well.
+    // - push: sets aren't allocated at all, but pushed into the command buffer with VK_KHR_push_descriptor while recording.
+    enum class DescriptorBackend {
+        pool,
+        buffer,
+        push
+    };
+
+    constexpr uint32_t MIN_FRAMES_IN_FLIGHT { 1 };
+    constexpr uint32_t MAX_FRAMES_IN_FLIGHT { 4 };
+
+    // The largest values the numeric flags accept. They are far above anything sensible, and only catch obvious mistakes.
+    constexpr uint32_t MAX_SWAPCHAIN_IMAGES { 16 };
+    constexpr uint32_t MAX_FPS_LIMIT { 10000 };
+    constexpr uint32_t MAX_WORKER_THREADS { 256 };
+    constexpr int MAX_RENDER_CPU { 1023 };
+
+    // Settings that are chosen once at startup.
+    struct RenderSettings {
+        LatencyMode latency_mode = LatencyMode::balanced;
+        uint32_t frames_in_flight = 2;
+
+        // The present mode we would like to use. If the surface doesn't support it,
+        // we fall back to the closest supported mode, and ultimately FIFO which is always supported.
+        VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+
+        // The minimum number of swapchain images to ask for. 0 lets the swapchain builder decide.
+        uint32_t swapchain_image_count = 0;
+
+        // Benchmark mode runs uncapped and reports frame timings.
+        bool benchmark = false;
+
+        // Delays the start of each frame so it finishes just before it's displayed. Requires VK_KHR_present_wait.
+        bool just_in_time_pacing = false;
+
+        // Caps the frame rate. 0 means no cap.
+        uint32_t fps_limit = 0;
+
+        // The number of worker threads in the job system. 0 uses all hardware threads.
+        uint32_t worker_threads = 0;
+
+        // The logical CPU to pin the render thread to. -1 lets the OS schedule it anywhere.
+        int render_thread_cpu = -1;
+        ThreadPriority render_thread_priority = ThreadPriority::high;
+
+        // Runs async compute passes on a dedicated compute queue, if the device has one.
+        bool async_compute = true;
+
+        // Watches the shader directory, and rebuilds the pipelines of shaders that were recompiled while running.
+        bool shader_hot_reload = true;
+
+        // Falls back to pool if the device doesn't support VK_EXT_descriptor_buffer or VK_KHR_push_descriptor.
+        DescriptorBackend descriptor_backend = DescriptorBackend::pool;
+    };
+
+    // Parses settings from the command line.
+    // A value that isn't one of the values a flag accepts, or a number outside of its range, stops the program with a message.
+    // --latency <low|balanced|throughput>  Selects a latency mode, which also picks a default frame count.
+    // --frames <1-4>                       Overrides the number of frames in flight.
+    // --present <fifo|fifo_relaxed|mailbox|immediate>  Selects the preferred present mode.
+    // --swapchain-images <n>               Selects the minimum number of swapchain images.
+    // --benchmark                          Runs uncapped (immediate present mode unless --present is given) and reports frame timings.
+    // --pacing <off|jit>                   Selects frame pacing. Defaults to jit (just in time) in low latency mode.
+    // --fps-limit <n>                      Caps the frame rate with a high precision sleep.
+    // --worker-threads <n>                 Selects the number of job system worker threads.
+    // --render-cpu <n>                     Pins the render thread to a logical CPU. -1 leaves it unpinned.
+    // --render-priority <normal|high|critical>  Selects the priority of the render thread.
+    // --async-compute <on|off>             Selects whether a dedicated compute queue is used.
+    // --hot-reload <on|off>                Selects whether changed shaders are reloaded while running.
+    // --descriptor-backend <pool|buffer|push>  Selects how per frame descriptor sets are allocated.
+    RenderSettings parse_render_settings(int argc, char** argv);
+
+    uint32_t default_frames_in_flight(LatencyMode mode);
+    const char* to_string(LatencyMode mode);
+    const char* to_string(VkPresentModeKHR present_mode);
+    const char* to_string(DescriptorBackend backend);
+}
+
+#endif // CIORAN_SETTINGS_H
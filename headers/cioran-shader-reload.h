@@ -0,0 +1,88 @@
+#ifndef CIORAN_SHADER_RELOAD_H
+#define CIORAN_SHADER_RELOAD_H
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "cioran-deferred.h"
+#include "cioran-jobs.h"
+#include "cioran-pipelines.h"
+
+namespace cioran {
+    // How often the watched files are checked on platforms without inotify.
+    constexpr std::chrono::milliseconds SHADER_POLL_INTERVAL { 500 };
+
+    // Notices when files in a directory are rewritten.
+    //
+    // On Linux this uses inotify, which the kernel fills with events as files are written, and reading it never blocks.
+    // Elsewhere it falls back to comparing the modification times of the watched files every SHADER_POLL_INTERVAL.
+    struct ShaderWatcher {
+        struct WatchedFile {
+            std::string name;
+            std::filesystem::file_time_type last_write_time;
+        };
+
+        std::string directory;
+        std::vector<WatchedFile> files;
+
+        // The inotify instance and its watch on the directory, or -1 when polling.
+        int inotify_fd { -1 };
+        int watch_descriptor { -1 };
+        std::chrono::steady_clock::time_point last_poll_time;
+
+        void init(const std::string& directory);
+        void destroy();
+
+        // Starts watching a file, given by its name within the directory.
+        void watch(const std::string& file_name);
+
+        // Returns the names of the watched files that changed since the last call, each name once. Never blocks.
+        std::vector<std::string> poll();
+
+        std::vector<std::string> poll_inotify();
+        std::vector<std::string> poll_modification_times();
+    };
+
+    // Rebuilds the pipelines of compute effects whose shaders changed on disk, without stalling the render loop.
+    //
+    // update() is called by the render thread at the start of every frame, before anything is recorded.
+    // It starts a rebuild on the background queue for every effect whose shader changed, and swaps in the pipelines of
+    // rebuilds that have finished. Swapping only happens there, so a frame never sees two versions of an effect.
+    // The old pipeline can still be used by frames in flight, so it goes to the deferred destroyer.
+    //
+    // A shader that fails to load or build keeps the old pipeline running, so a typo doesn't take down the renderer.
+    // The effect's layout is reused, so a reloaded shader has to keep the same descriptor sets and push constants.
+    struct ShaderHotReload {
+        struct Rebuild {
+            ComputeEffect* effect;
+            JobHandle job;
+            // Written by the job. VK_NULL_HANDLE if the rebuild failed.
+            VkPipeline pipeline;
+        };
+
+        VkDevice device;
+        VkPipelineCache pipeline_cache;
+        ShaderWatcher watcher;
+        std::vector<ComputeEffect*> effects;
+        // The rebuilds are referenced by their jobs, so they need stable addresses.
+        std::vector<std::unique_ptr<Rebuild>> rebuilds;
+
+        void init(VkDevice device, VkPipelineCache pipeline_cache, const std::string& shader_directory);
+        // Waits for the rebuilds that are still running, and destroys pipelines that were never swapped in.
+        // It waits on the rebuilds' own job handles, so it doesn't need the background queue, and doesn't wait for anything else on it.
+        // The queue has to finish the rebuild jobs it holds though, so it must not be dropped without shutdown(), which runs them.
+        void destroy();
+
+        // Reloads the effect whenever its shader file changes. The effect has to outlive the hot reload.
+        void add_effect(ComputeEffect& effect);
+
+        void update(BackgroundQueue& background, DeferredDestroyer& destroyer);
+    };
+}
+
+#endif // CIORAN_SHADER_RELOAD_H
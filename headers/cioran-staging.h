@@ -0,0 +1,52 @@
+#ifndef CIORAN_STAGING_H
+#define CIORAN_STAGING_H
+
+#include <cstdint>
+#include <deque>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_mem_alloc.h"
+
+#include "cioran-vulkan.h"
+
+namespace cioran {
+    // A fixed size ring buffer in host visible memory, which stays mapped for its whole lifetime.
+    //
+    // Staging data is written at the head of the ring. Every submission that reads from the ring closes a batch,
+    // which remembers how far the head had come and the timeline value the submission signals.
+    // Once the timeline reaches that value, the space up to the end of the batch is free again and the tail moves forward.
+    //
+    // Allocating is just moving the head, so there are no driver calls and no fragmentation.
+    // An allocation that doesn't fit before the end of the ring skips the rest of it, and starts over at the beginning.
+    struct StagingRing {
+        struct ClosedBatch {
+            uint64_t timeline_value;
+            uint64_t end;
+        };
+
+        AllocatedBuffer buffer;
+        uint8_t* mapped;
+        VkDeviceSize capacity;
+
+        // The head and tail only ever grow. Their difference is the space in use, and their position in the ring is the value modulo the capacity.
+        uint64_t head;
+        uint64_t tail;
+        std::deque<ClosedBatch> closed_batches;
+
+        void init(VmaAllocator allocator, VkDeviceSize capacity);
+        void destroy(VmaAllocator allocator);
+
+        // Reserves size bytes at the given alignment. Returns false if there isn't enough free space right now.
+        // The offset is from the start of the buffer, and pointer is where to write the data.
+        bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset, void*& pointer);
+
+        // Everything allocated since the last closed batch is in use until the timeline reaches the given value.
+        void close_batch(uint64_t timeline_value);
+
+        // Frees the batches the timeline has passed.
+        void reclaim(uint64_t completed_value);
+    };
+}
+
+#endif // CIORAN_STAGING_H
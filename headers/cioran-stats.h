@@ -0,0 +1,42 @@
+#ifndef CIORAN_STATS_H
+#define CIORAN_STATS_H
+
+#include <chrono>
+#include <cstdint>
+
+namespace cioran {
+    // Collects frame timings and prints a summary at a fixed interval.
+    // The frame time is the time between two presents, which is what the user sees.
+    // The CPU time is the part of the frame where the CPU was actually working, not waiting for the GPU or the swapchain.
+    struct FrameStats {
+        using Clock = std::chrono::steady_clock;
+
+        Clock::time_point last_frame_end;
+        Clock::time_point last_report;
+        Clock::time_point cpu_start;
+
+        double frame_time_sum_ms;
+        double frame_time_min_ms;
+        double frame_time_max_ms;
+        double cpu_time_sum_ms;
+        double latency_sum_ms;
+        uint32_t frame_count;
+        uint32_t latency_count;
+
+        void init();
+
+        // Marks the point where the CPU starts working on a frame, after all waits.
+        void begin_cpu_work();
+
+        // Marks the end of the CPU work and the end of the frame.
+        // Prints a report when the report interval has passed.
+        void end_frame();
+
+        // Records a measured input-to-display latency, when the frame pacer can provide one.
+        void record_latency(double latency_ms);
+
+        void reset_interval();
+    };
+}
+
+#endif // CIORAN_STATS_H
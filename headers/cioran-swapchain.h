@@ -0,0 +1,70 @@
+#ifndef CIORAN_SWAPCHAIN_H
+#define CIORAN_SWAPCHAIN_H
+
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace cioran {
+    // Destroys old swapchains once the presentation engine is done with them.
+    //
+    // It's not enough that the GPU has finished the frames that rendered to an old swapchain. Presents are queue operations
+    // of their own, and the presentation engine can still be reading an old image, or waiting on its semaphore, after that.
+    // How we find out that it's done depends on what the device supports, from best to worst:
+    // 1. VK_EXT_swapchain_maintenance1 lets every present signal a fence once the presentation engine is done with it.
+    //    An old swapchain is destroyed once the fences of all presents to it have signaled.
+    // 2. With VK_KHR_present_wait, presents complete in order. Once a present to the new swapchain has been displayed,
+    //    every present to the old one has completed as well.
+    // 3. Without either, there is no way to tell, so we wait for the device to go idle and destroy the swapchain right away.
+    //    Swapchains are only recreated on resizes, so the stall is rare.
+    struct SwapchainRetirement {
+        struct PendingPresent {
+            VkFence fence;
+            // The generation of the swapchain the present went to.
+            uint64_t generation;
+        };
+
+        struct RetiredSwapchain {
+            VkSwapchainKHR swapchain;
+            std::vector<VkImageView> image_views;
+            uint64_t generation;
+            // The id of the first present to the swapchain that replaced this one.
+            uint64_t replacement_present_id;
+        };
+
+        VkDevice device;
+        bool present_fences;
+        bool present_wait;
+
+        // Counts the swapchains, so presents can be matched up with the swapchain they went to.
+        uint64_t generation;
+        std::vector<VkFence> free_fences;
+        // In the order they were presented.
+        std::deque<PendingPresent> pending_presents;
+        std::vector<RetiredSwapchain> retired;
+
+        void init(VkDevice device, bool present_fences_enabled, bool present_wait_enabled);
+        // Waits for the presents that are still pending, and destroys every retired swapchain and the fences.
+        // The device must be idle.
+        void destroy();
+
+        // The fence to signal from the next present, chained into it with VkSwapchainPresentFenceInfoEXT.
+        // Only used with present fences.
+        VkFence next_present_fence();
+
+        // Takes over an old swapchain and its image views. The new swapchain must already have been created from it.
+        // next_present_id is the present id the first present to the new swapchain gets.
+        void retire(VkSwapchainKHR swapchain, std::span<const VkImageView> image_views, uint64_t next_present_id);
+
+        // Destroys the retired swapchains the presentation engine is done with. Called once per frame.
+        // last_displayed_present_id is the newest present id known to have been displayed, for the present wait path.
+        void collect(uint64_t last_displayed_present_id);
+
+        void destroy_swapchain(const RetiredSwapchain& swapchain);
+    };
+}
+
+#endif // CIORAN_SWAPCHAIN_H
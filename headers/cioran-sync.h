@@ -0,0 +1,43 @@
+#ifndef CIORAN_SYNC_H
+#define CIORAN_SYNC_H
+
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+namespace cioran {
+    // A timeline semaphore is a semaphore with a monotonically increasing 64-bit counter.
+    // Instead of a binary signaled / unsignaled state, submissions signal the semaphore to a specific value,
+    // and both the host and other submissions can wait for the counter to reach a specific value.
+    // Unlike fences, they never have to be reset, which means one timeline per queue can replace
+    // a fence per frame in flight.
+    struct QueueTimeline {
+        VkSemaphore semaphore;
+
+        // The value that the last submitted signal operation will set the counter to.
+        uint64_t last_submitted_value;
+
+        // The last counter value we have observed on the host.
+        // Caching it lets us skip the driver call when waiting for work we already know has finished.
+        uint64_t completed_value;
+
+        void init(VkDevice device);
+        void destroy(VkDevice device);
+
+        // Reserves the value that the next submission to the queue should signal.
+        uint64_t next_signal_value();
+
+        // Queries the driver for the current counter value.
+        uint64_t poll(VkDevice device);
+        bool is_complete(VkDevice device, uint64_t value);
+
+        // Blocks the host until the counter reaches the given value, or the timeout (in nanoseconds) expires.
+        // Returns false on timeout.
+        bool wait(VkDevice device, uint64_t value, uint64_t timeout);
+
+        VkSemaphoreSubmitInfo signal_info(VkPipelineStageFlags2 stage_mask, uint64_t value) const;
+        VkSemaphoreSubmitInfo wait_info(VkPipelineStageFlags2 stage_mask, uint64_t value) const;
+    };
+}
+
+#endif // CIORAN_SYNC_H
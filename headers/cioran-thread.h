@@ -0,0 +1,20 @@
+#ifndef CIORAN_THREAD_H
+#define CIORAN_THREAD_H
+
+#include <cstdint>
+
+namespace cioran {
+    enum class ThreadPriority {
+        normal,
+        high,
+        time_critical
+    };
+
+    // Pins the calling thread to a single logical CPU. Returns false if the platform doesn't support it, or the call failed.
+    bool set_current_thread_affinity(uint32_t cpu_index);
+
+    // Changes the scheduling priority of the calling thread. Raising the priority may require extra privileges on some platforms.
+    bool set_current_thread_priority(ThreadPriority priority);
+}
+
+#endif // CIORAN_THREAD_H
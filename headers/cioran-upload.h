@@ -0,0 +1,126 @@
+#ifndef CIORAN_UPLOAD_H
+#define CIORAN_UPLOAD_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_mem_alloc.h"
+
+#include "cioran-barriers.h"
+#include "cioran-staging.h"
+#include "cioran-sync.h"
+#include "cioran-vulkan.h"
+
+namespace cioran {
+    // The default size of the staging ring. Uploads that don't fit into it get a temporary staging buffer.
+    constexpr VkDeviceSize DEFAULT_STAGING_RING_SIZE { 32 * 1024 * 1024 };
+
+    // Staging allocations are aligned to this, which covers the copy offset requirements of buffers and of all formats with 1, 2, 4, 8 or 16 byte texels.
+    constexpr VkDeviceSize STAGING_ALIGNMENT { 16 };
+
+    // Copies data from the CPU into buffers and images on the GPU.
+    //
+    // The data is copied into a persistently mapped staging ring first, which the GPU copies from.
+    // Uploads can be requested from any thread. They are gathered, and flush() records all of them into
+    // a single command buffer, which is submitted once per frame to a dedicated transfer queue if the device has one.
+    // Every upload returns the value the upload timeline reaches once it is done, which callers can poll,
+    // so nothing ever has to wait for the queue to go idle.
+    //
+    // On a dedicated transfer queue, the destinations are released to the graphics queue after the copy.
+    // The graphics queue acquires them in acquire_completed_uploads(), once the upload has finished,
+    // so the graphics queue never waits for uploads that are still in flight.
+    // Until then the destination belongs to the transfer queue and must not be used.
+    //
+    // The destination of an upload must not be in use by the GPU, for example a newly created resource.
+    // Contents outside of the uploaded region are not preserved when the destination moves between queue families.
+    struct UploadManager {
+        struct BufferUpload {
+            VkBuffer staging;
+            VkDeviceSize staging_offset;
+            VkBuffer destination;
+            BufferState* state;
+            VkBufferCopy region;
+            BufferUsage final_usage;
+        };
+
+        struct ImageUpload {
+            VkBuffer staging;
+            VkDeviceSize staging_offset;
+            VkImage destination;
+            ImageState* state;
+            VkExtent3D extent;
+            ImageUsage final_usage;
+        };
+
+        // A submitted release, which the graphics queue still has to acquire.
+        struct PendingAcquire {
+            uint64_t timeline_value;
+            VkBuffer buffer;
+            BufferState* buffer_state;
+            BufferUsage buffer_usage;
+            VkImage image;
+            ImageState* image_state;
+            ImageUsage image_usage;
+        };
+
+        // The command buffer of one submission, and the temporary staging buffers it reads from.
+        // Both can be reused once the timeline has passed the batch's value.
+        struct UploadBatch {
+            VkCommandPool pool;
+            VkCommandBuffer cmd;
+            uint64_t timeline_value;
+            std::vector<AllocatedBuffer> staging_buffers;
+        };
+
+        VkDevice device;
+        VmaAllocator allocator;
+        VkQueue queue;
+        uint32_t queue_family;
+        uint32_t graphics_queue_family;
+        QueueTimeline timeline;
+
+        // Guards everything below, since uploads can come from any thread.
+        std::mutex mutex;
+        std::vector<BufferUpload> buffer_uploads;
+        std::vector<ImageUpload> image_uploads;
+        StagingRing staging_ring;
+        // Temporary staging buffers for uploads that don't fit into the ring.
+        std::vector<AllocatedBuffer> staging_buffers;
+        std::vector<UploadBatch> batches;
+        std::vector<PendingAcquire> pending_acquires;
+        // Every upload up to this value is done, and owned by the graphics queue.
+        uint64_t ready_value;
+
+        // queue can be the graphics queue when there is no dedicated transfer queue.
+        void init(VkDevice device, VmaAllocator allocator, VkQueue queue, uint32_t queue_family, uint32_t graphics_queue_family, VkDeviceSize staging_ring_size = DEFAULT_STAGING_RING_SIZE);
+        void destroy();
+
+        // Copies size bytes of data into the buffer at the given offset. The buffer needs VK_BUFFER_USAGE_TRANSFER_DST_BIT.
+        // Returns the timeline value the upload is done at.
+        uint64_t upload_buffer(const void* data, VkDeviceSize size, VkBuffer destination, VkDeviceSize destination_offset, BufferState& state, BufferUsage final_usage);
+
+        // Copies tightly packed texel data into the first mip level of the whole image. The image needs VK_IMAGE_USAGE_TRANSFER_DST_BIT.
+        // Whole images can always be copied on a transfer queue, regardless of its image transfer granularity.
+        // Afterwards the image is in the layout of final_usage.
+        uint64_t upload_image(const void* data, VkDeviceSize size, VkImage destination, VkExtent3D extent, ImageState& state, ImageUsage final_usage);
+
+        // Records and submits all uploads requested since the last flush. Returns the value the batch signals, or 0 if there was nothing to upload.
+        uint64_t flush();
+
+        // Adds the acquires of all finished uploads to the graphics barriers.
+        // Returns the upload timeline value the graphics submission has to wait for at wait_stage, or 0 if there is nothing to wait for.
+        uint64_t acquire_completed_uploads(BarrierBatch& barriers, VkPipelineStageFlags2& wait_stage);
+
+        // Whether the upload that returned this value is done, and the destination can be used on the graphics queue.
+        bool is_ready(uint64_t value);
+
+        // Copies the data into the staging ring, or a temporary staging buffer if it doesn't fit. Requires the mutex to be held.
+        VkBuffer stage(const void* data, VkDeviceSize size, VkDeviceSize& offset);
+        UploadBatch& next_batch();
+    };
+}
+
+#endif // CIORAN_UPLOAD_H
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <deque>
 #include <functional>
+#include <utility>
 
 // Currently my own vulkan implementation depends on VkBootstrap.
 #include "vkbootstrap/VkBootstrap.h"
@@ -15,12 +16,14 @@
 // VMA
 #include "vk_mem_alloc.h"
 
+#include "cioran-barriers.h"
+
 namespace cioran {
     struct VkDeletionQueue {
         std::deque<std::function<void()>> deletors;
 
         void push_function(std::function<void()>&& function) {
-            deletors.push_back(function);
+            deletors.push_back(std::move(function));
         }
 
         void flush() {
@@ -39,17 +42,41 @@ namespace cioran {
         VmaAllocation allocation;
         VkExtent3D image_extent;
         VkFormat image_format;
+        // The layout and accesses the image was left in by its last use, used to build the next barrier.
+        ImageState state;
+    };
+
+    struct AllocatedBuffer {
+        VkBuffer buffer;
+        VmaAllocation allocation;
+        // Holds the mapped pointer for host visible buffers created with the mapped flag.
+        VmaAllocationInfo info;
+        VkDeviceSize size;
+        BufferState state;
     };
 
     vkb::Instance initialize_vulkan();
     VkSurfaceKHR get_window_surface(SDL_Window* window, VkInstance instance);
     vkb::PhysicalDevice get_physical_device(vkb::Instance instance, VkSurfaceKHR surface);
-    vkb::Swapchain create_swapchain(vkb::PhysicalDevice physicalDevice, VkDevice logicalDevice, VkSurfaceKHR surface, uint32_t window_width, uint32_t window_height, VkFormat& vk_swapchain_format);
+    // Enables VK_KHR_present_id and VK_KHR_present_wait on the device if they are supported.
+    bool enable_present_wait(vkb::PhysicalDevice& physical_device);
+    // Enables VK_EXT_swapchain_maintenance1 on the device if it and the instance support it.
+    bool enable_swapchain_maintenance(vkb::PhysicalDevice& physical_device);
+    // Enables VK_EXT_descriptor_buffer on the device if it is supported.
+    bool enable_descriptor_buffer(vkb::PhysicalDevice& physical_device);
+    // Enables VK_KHR_push_descriptor on the device if it is supported.
+    bool enable_push_descriptor(vkb::PhysicalDevice& physical_device);
+    // Picks the preferred present mode if the surface supports it, otherwise the closest supported one.
+    VkPresentModeKHR choose_present_mode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkPresentModeKHR preferred_mode);
+    vkb::Swapchain create_swapchain(vkb::PhysicalDevice physicalDevice, VkDevice logicalDevice, VkSurfaceKHR surface, uint32_t window_width, uint32_t window_height, VkPresentModeKHR present_mode, uint32_t min_image_count, VkFormat& vk_swapchain_format, VkSwapchainKHR old_swapchain = VK_NULL_HANDLE);
 
     VkImageCreateInfo create_image_create_info(VkFormat format, VkImageUsageFlags usage, VkExtent3D extent);
     VkImageViewCreateInfo create_image_view_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspect_flags);
 
-    VkCommandPool create_command_pool(VkDevice logicalDevice, uint32_t queue_family_index);
+    AllocatedBuffer create_buffer(VmaAllocator allocator, VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memory_usage, VmaAllocationCreateFlags allocation_flags = 0);
+    void destroy_buffer(VmaAllocator allocator, const AllocatedBuffer& buffer);
+
+    VkCommandPool create_command_pool(VkDevice logicalDevice, uint32_t queue_family_index, VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
     VkCommandBuffer create_command_buffer(VkDevice logicalDevice, VkCommandPool command_pool);
 }
 
@@ -0,0 +1,267 @@
+#include "cioran-barriers.h"
+
+namespace cioran {
+    // The access bits that write to memory.
+    // Only writes have to be made available by a barrier, read accesses in a source access mask don't do anything.
+    constexpr VkAccessFlags2 WRITE_ACCESS_MASK {
+        VK_ACCESS_2_SHADER_WRITE_BIT |
+        VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_2_TRANSFER_WRITE_BIT |
+        VK_ACCESS_2_HOST_WRITE_BIT |
+        VK_ACCESS_2_MEMORY_WRITE_BIT
+    };
+
+    static VkImageSubresourceRange whole_image_range(ImageUsage usage)
+    {
+        VkImageSubresourceRange range {};
+        range.aspectMask = usage == ImageUsage::depth_attachment ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        range.baseMipLevel = 0;
+        range.levelCount = VK_REMAINING_MIP_LEVELS;
+        range.baseArrayLayer = 0;
+        range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+        return range;
+    }
+
+    ImageState image_state_for(ImageUsage usage)
+    {
+        switch (usage) {
+            case ImageUsage::transfer_src:
+                return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT };
+            case ImageUsage::transfer_dst:
+                return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT };
+            case ImageUsage::compute_storage_read:
+                return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT };
+            case ImageUsage::compute_storage_write:
+                return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+            case ImageUsage::compute_storage_read_write:
+                return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+            case ImageUsage::compute_sampled:
+                return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT };
+            case ImageUsage::fragment_sampled:
+                return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT };
+            case ImageUsage::color_attachment:
+                return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT };
+            case ImageUsage::depth_attachment:
+                return { VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+            case ImageUsage::present:
+            default:
+                // Presentation happens outside of the pipeline, and is ordered by the semaphore given to vkQueuePresentKHR.
+                // So there is nothing for the barrier to wait for, other than the layout transition itself.
+                return { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE };
+        }
+    }
+
+    BufferState buffer_state_for(BufferUsage usage)
+    {
+        switch (usage) {
+            case BufferUsage::transfer_src:
+                return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT };
+            case BufferUsage::transfer_dst:
+                return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT };
+            case BufferUsage::compute_storage_read:
+                return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT };
+            case BufferUsage::compute_storage_write:
+                return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+            case BufferUsage::compute_storage_read_write:
+                return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+            case BufferUsage::uniform_read:
+                return { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_UNIFORM_READ_BIT };
+            case BufferUsage::vertex_input:
+                return { VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT };
+            case BufferUsage::index_input:
+                return { VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT };
+            case BufferUsage::indirect_argument:
+                return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT };
+            case BufferUsage::host_read:
+            default:
+                return { VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT };
+        }
+    }
+
+    void BarrierBatch::transition(VkImage image, ImageState& state, ImageUsage next_usage, bool discard_contents)
+    {
+        ImageState next = image_state_for(next_usage);
+
+        bool previous_writes = (state.access & WRITE_ACCESS_MASK) != 0;
+        bool next_writes = (next.access & WRITE_ACCESS_MASK) != 0;
+
+        // Reading after reading in the same layout is safe without a barrier.
+        // We remember both readers though, so a later write waits for all of them.
+        if (state.layout == next.layout && !previous_writes && !next_writes && state.stage != VK_PIPELINE_STAGE_2_NONE) {
+            state.stage |= next.stage;
+            state.access |= next.access;
+            return;
+        }
+
+        VkImageMemoryBarrier2 barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+
+        // Wait for the stages of the previous use. Only its writes have to be made available.
+        // A write after read hazard only needs the execution dependency.
+        barrier.srcStageMask = state.stage;
+        barrier.srcAccessMask = state.access & WRITE_ACCESS_MASK;
+
+        barrier.dstStageMask = next.stage;
+        barrier.dstAccessMask = next.access;
+
+        // Transitioning from the undefined layout tells the driver it doesn't have to preserve the contents.
+        barrier.oldLayout = discard_contents ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+        barrier.newLayout = next.layout;
+
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+        barrier.image = image;
+        barrier.subresourceRange = whole_image_range(next_usage);
+
+        image_barriers.push_back(barrier);
+
+        next.queue_family = state.queue_family;
+        state = next;
+    }
+
+    void BarrierBatch::transition(VkBuffer buffer, BufferState& state, BufferUsage next_usage)
+    {
+        BufferState next = buffer_state_for(next_usage);
+
+        bool previous_writes = (state.access & WRITE_ACCESS_MASK) != 0;
+        bool next_writes = (next.access & WRITE_ACCESS_MASK) != 0;
+
+        // Without layouts, any two reads can overlap.
+        if (!previous_writes && !next_writes && state.stage != VK_PIPELINE_STAGE_2_NONE) {
+            state.stage |= next.stage;
+            state.access |= next.access;
+            return;
+        }
+
+        VkBufferMemoryBarrier2 barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        barrier.srcStageMask = state.stage;
+        barrier.srcAccessMask = state.access & WRITE_ACCESS_MASK;
+        barrier.dstStageMask = next.stage;
+        barrier.dstAccessMask = next.access;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        buffer_barriers.push_back(barrier);
+
+        next.queue_family = state.queue_family;
+        state = next;
+    }
+
+    void BarrierBatch::release(VkImage image, const ImageState& state, ImageUsage next_usage, uint32_t dst_queue_family)
+    {
+        ImageState next = image_state_for(next_usage);
+
+        // The release waits for the last use on the owning queue. The destination scope is ignored,
+        // since nothing after the release on this queue uses the image anymore.
+        VkImageMemoryBarrier2 barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = state.stage;
+        barrier.srcAccessMask = state.access & WRITE_ACCESS_MASK;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.dstAccessMask = VK_ACCESS_2_NONE;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = next.layout;
+        barrier.srcQueueFamilyIndex = state.queue_family;
+        barrier.dstQueueFamilyIndex = dst_queue_family;
+        barrier.image = image;
+        barrier.subresourceRange = whole_image_range(next_usage);
+
+        image_barriers.push_back(barrier);
+    }
+
+    void BarrierBatch::acquire(VkImage image, ImageState& state, ImageUsage next_usage, uint32_t dst_queue_family)
+    {
+        ImageState next = image_state_for(next_usage);
+
+        // The source scope is the semaphore wait, which happens at the stages of the next use.
+        // The source access mask is ignored, the release already made the writes available.
+        VkImageMemoryBarrier2 barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = next.stage;
+        barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        barrier.dstStageMask = next.stage;
+        barrier.dstAccessMask = next.access;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = next.layout;
+        barrier.srcQueueFamilyIndex = state.queue_family;
+        barrier.dstQueueFamilyIndex = dst_queue_family;
+        barrier.image = image;
+        barrier.subresourceRange = whole_image_range(next_usage);
+
+        image_barriers.push_back(barrier);
+
+        next.queue_family = dst_queue_family;
+        state = next;
+    }
+
+    void BarrierBatch::release(VkBuffer buffer, const BufferState& state, BufferUsage next_usage, uint32_t dst_queue_family)
+    {
+        VkBufferMemoryBarrier2 barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        barrier.srcStageMask = state.stage;
+        barrier.srcAccessMask = state.access & WRITE_ACCESS_MASK;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.dstAccessMask = VK_ACCESS_2_NONE;
+        barrier.srcQueueFamilyIndex = state.queue_family;
+        barrier.dstQueueFamilyIndex = dst_queue_family;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        buffer_barriers.push_back(barrier);
+    }
+
+    void BarrierBatch::acquire(VkBuffer buffer, BufferState& state, BufferUsage next_usage, uint32_t dst_queue_family)
+    {
+        BufferState next = buffer_state_for(next_usage);
+
+        VkBufferMemoryBarrier2 barrier {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        barrier.srcStageMask = next.stage;
+        barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        barrier.dstStageMask = next.stage;
+        barrier.dstAccessMask = next.access;
+        barrier.srcQueueFamilyIndex = state.queue_family;
+        barrier.dstQueueFamilyIndex = dst_queue_family;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        buffer_barriers.push_back(barrier);
+
+        next.queue_family = dst_queue_family;
+        state = next;
+    }
+
+    void BarrierBatch::flush(VkCommandBuffer cmd)
+    {
+        if (empty()) {
+            return;
+        }
+
+        VkDependencyInfo dependency_info {};
+        dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency_info.imageMemoryBarrierCount = (uint32_t)image_barriers.size();
+        dependency_info.pImageMemoryBarriers = image_barriers.data();
+        dependency_info.bufferMemoryBarrierCount = (uint32_t)buffer_barriers.size();
+        dependency_info.pBufferMemoryBarriers = buffer_barriers.data();
+
+        vkCmdPipelineBarrier2(cmd, &dependency_info);
+
+        image_barriers.clear();
+        buffer_barriers.clear();
+    }
+
+    bool BarrierBatch::empty() const
+    {
+        return image_barriers.empty() && buffer_barriers.empty();
+    }
+}
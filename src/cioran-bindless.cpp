@@ -0,0 +1,268 @@
+#include "cioran-bindless.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace cioran {
+    void BindlessHeap::init(VkDevice device, VkPhysicalDevice physical_device, DescriptorLayoutCache& layout_cache, VmaAllocator descriptor_buffer_allocator)
+    {
+        this->device = device;
+        allocator = descriptor_buffer_allocator;
+        in_descriptor_buffer = descriptor_buffer_allocator != VK_NULL_HANDLE;
+        buffer_written = false;
+        sampler_count = 0;
+
+        if (in_descriptor_buffer) {
+            init_descriptor_buffer(physical_device, layout_cache);
+            return;
+        }
+
+        // Update after bind descriptors have their own, often lower, limits.
+        VkPhysicalDeviceDescriptorIndexingProperties indexing_properties {};
+        indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &indexing_properties;
+        vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+        image_capacity = std::min({
+            MAX_BINDLESS_IMAGES,
+            indexing_properties.maxDescriptorSetUpdateAfterBindStorageImages,
+            indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageImages,
+            indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+            indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages
+        });
+        sampler_capacity = std::min({
+            MAX_BINDLESS_SAMPLERS,
+            indexing_properties.maxDescriptorSetUpdateAfterBindSamplers,
+            indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers
+        });
+        buffer_capacity = std::min({
+            MAX_BINDLESS_BUFFERS,
+            indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+            indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers
+        });
+
+        VkDescriptorSetLayoutBinding bindings[] = {
+            { BINDLESS_STORAGE_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, image_capacity, 0, nullptr },
+            { BINDLESS_SAMPLED_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, image_capacity, 0, nullptr },
+            { BINDLESS_SAMPLER_BINDING, VK_DESCRIPTOR_TYPE_SAMPLER, sampler_capacity, 0, nullptr },
+            { BINDLESS_STORAGE_BUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer_capacity, 0, nullptr }
+        };
+
+        VkDescriptorBindingFlags binding_flags[4];
+        for (VkDescriptorBindingFlags& flags : binding_flags) {
+            flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+                | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+                | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        }
+
+        // The layout belongs to the cache, so pipelines that ask the cache for the same layout get this very handle.
+        layout = layout_cache.get(bindings, VK_SHADER_STAGE_ALL, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT, binding_flags);
+
+        VkDescriptorPoolSize pool_sizes[] = {
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, image_capacity },
+            { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, image_capacity },
+            { VK_DESCRIPTOR_TYPE_SAMPLER, sampler_capacity },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer_capacity }
+        };
+
+        VkDescriptorPoolCreateInfo pool_info = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+        pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        pool_info.maxSets = 1;
+        pool_info.poolSizeCount = 4;
+        pool_info.pPoolSizes = pool_sizes;
+
+        if (vkCreateDescriptorPool(device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+            std::cout << "Failed to create bindless descriptor pool" << std::endl;
+            std::terminate();
+        }
+
+        VkDescriptorSetAllocateInfo alloc_info {};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &layout;
+
+        if (vkAllocateDescriptorSets(device, &alloc_info, &set) != VK_SUCCESS) {
+            std::cout << "Failed to allocate bindless descriptor set" << std::endl;
+            std::terminate();
+        }
+
+        std::cout << "Bindless heap: " << image_capacity << " images, " << sampler_capacity << " samplers, " << buffer_capacity << " buffers" << std::endl;
+    }
+
+    void BindlessHeap::init_descriptor_buffer(VkPhysicalDevice physical_device, DescriptorLayoutCache& layout_cache)
+    {
+        // Without update after bind, the regular limits apply.
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        const VkPhysicalDeviceLimits& limits = properties.limits;
+
+        image_capacity = std::min({
+            MAX_BINDLESS_IMAGES,
+            limits.maxDescriptorSetStorageImages,
+            limits.maxPerStageDescriptorStorageImages,
+            limits.maxDescriptorSetSampledImages,
+            limits.maxPerStageDescriptorSampledImages
+        });
+        sampler_capacity = std::min({ MAX_BINDLESS_SAMPLERS, limits.maxDescriptorSetSamplers, limits.maxPerStageDescriptorSamplers });
+        buffer_capacity = std::min({ MAX_BINDLESS_BUFFERS, limits.maxDescriptorSetStorageBuffers, limits.maxPerStageDescriptorStorageBuffers });
+
+        // The heap holds samplers, so its buffer is a sampler descriptor buffer as well as a resource one, and the set has to fit both ranges.
+        // Sampler ranges can be small, so the image and buffer arrays shrink until the descriptors fit.
+        VkPhysicalDeviceDescriptorBufferPropertiesEXT buffer_properties = query_descriptor_buffer_properties(physical_device);
+        VkDeviceSize max_range = std::min(buffer_properties.maxResourceDescriptorBufferRange, buffer_properties.maxSamplerDescriptorBufferRange);
+        auto heap_size = [&]() {
+            return image_capacity * (buffer_properties.storageImageDescriptorSize + buffer_properties.sampledImageDescriptorSize)
+                + sampler_capacity * buffer_properties.samplerDescriptorSize
+                + buffer_capacity * buffer_properties.storageBufferDescriptorSize;
+        };
+        while (heap_size() > max_range && image_capacity > 1) {
+            image_capacity /= 2;
+            buffer_capacity = std::max(buffer_capacity / 2, 1u);
+        }
+
+        VkDescriptorSetLayoutBinding bindings[] = {
+            { BINDLESS_STORAGE_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, image_capacity, 0, nullptr },
+            { BINDLESS_SAMPLED_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, image_capacity, 0, nullptr },
+            { BINDLESS_SAMPLER_BINDING, VK_DESCRIPTOR_TYPE_SAMPLER, sampler_capacity, 0, nullptr },
+            { BINDLESS_STORAGE_BUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer_capacity, 0, nullptr }
+        };
+
+        // Descriptor buffer layouts can't be update after bind. Unwritten elements are fine as long as the arrays are partially bound.
+        VkDescriptorBindingFlags binding_flags[4];
+        for (VkDescriptorBindingFlags& flags : binding_flags) {
+            flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+        }
+
+        layout = layout_cache.get(bindings, VK_SHADER_STAGE_ALL, VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT, binding_flags);
+        pool = VK_NULL_HANDLE;
+        set = VK_NULL_HANDLE;
+
+        // The buffer is exactly as big as the set, which may be padded beyond the descriptors themselves.
+        DescriptorBufferFunctions functions;
+        functions.load(device);
+        VkDeviceSize layout_size;
+        functions.get_layout_size(device, layout, &layout_size);
+
+        descriptor_buffer.init(device, physical_device, allocator, layout_size,
+            VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT);
+        buffer_set = descriptor_buffer.allocate(layout);
+
+        std::cout << "Bindless heap: " << image_capacity << " images, " << sampler_capacity << " samplers, " << buffer_capacity << " buffers"
+            << ", in a descriptor buffer of " << layout_size << " bytes" << std::endl;
+    }
+
+    void BindlessHeap::destroy()
+    {
+        if (in_descriptor_buffer) {
+            descriptor_buffer.destroy(allocator);
+        } else {
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+    }
+
+    void BindlessHeap::write_storage_image(uint32_t index, VkImageView view)
+    {
+        if (index >= image_capacity) {
+            std::cout << "Storage image index " << index << " is outside of the bindless heap" << std::endl;
+            std::terminate();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (in_descriptor_buffer) {
+            descriptor_buffer.write_storage_image(buffer_set, BINDLESS_STORAGE_IMAGE_BINDING, view, index);
+            buffer_written = true;
+            return;
+        }
+        writer.write_image(BINDLESS_STORAGE_IMAGE_BINDING, view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, index);
+    }
+
+    void BindlessHeap::write_sampled_image(uint32_t index, VkImageView view)
+    {
+        if (index >= image_capacity) {
+            std::cout << "Sampled image index " << index << " is outside of the bindless heap" << std::endl;
+            std::terminate();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (in_descriptor_buffer) {
+            descriptor_buffer.write_sampled_image(buffer_set, BINDLESS_SAMPLED_IMAGE_BINDING, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, index);
+            buffer_written = true;
+            return;
+        }
+        writer.write_image(BINDLESS_SAMPLED_IMAGE_BINDING, view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, index);
+    }
+
+    void BindlessHeap::write_storage_buffer(uint32_t index, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+    {
+        if (index >= buffer_capacity) {
+            std::cout << "Storage buffer index " << index << " is outside of the bindless heap" << std::endl;
+            std::terminate();
+        }
+
+        if (in_descriptor_buffer) {
+            if (range == VK_WHOLE_SIZE) {
+                std::cout << "Storage buffers in a descriptor buffer need an explicit range" << std::endl;
+                std::terminate();
+            }
+
+            VkBufferDeviceAddressInfo address_info {};
+            address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+            address_info.buffer = buffer;
+            VkDeviceAddress address = vkGetBufferDeviceAddress(device, &address_info) + offset;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            descriptor_buffer.write_storage_buffer(buffer_set, BINDLESS_STORAGE_BUFFER_BINDING, address, range, index);
+            buffer_written = true;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        writer.write_buffer(BINDLESS_STORAGE_BUFFER_BINDING, buffer, range, offset, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, index);
+    }
+
+    uint32_t BindlessHeap::add_sampler(VkSampler sampler)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (sampler_count >= sampler_capacity) {
+            std::cout << "The bindless heap is out of sampler slots" << std::endl;
+            std::terminate();
+        }
+
+        uint32_t index = sampler_count++;
+        if (in_descriptor_buffer) {
+            descriptor_buffer.write_sampler(buffer_set, BINDLESS_SAMPLER_BINDING, sampler, index);
+            buffer_written = true;
+            return index;
+        }
+        writer.write_image(BINDLESS_SAMPLER_BINDING, VK_NULL_HANDLE, sampler, VK_IMAGE_LAYOUT_UNDEFINED, VK_DESCRIPTOR_TYPE_SAMPLER, index);
+        return index;
+    }
+
+    void BindlessHeap::flush()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // The descriptors are already in the buffer, they only have to be made visible to the GPU.
+        if (in_descriptor_buffer) {
+            if (buffer_written) {
+                descriptor_buffer.flush(allocator);
+                buffer_written = false;
+            }
+            return;
+        }
+
+        // Every write targets the one set, so they all go out together.
+        writer.update_set(set);
+        writer.flush(device);
+    }
+
+    void BindlessHeap::bind(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout) const
+    {
+        vkCmdBindDescriptorSets(cmd, bind_point, pipeline_layout, 0, 1, &set, 0, nullptr);
+    }
+}
@@ -0,0 +1,120 @@
+#include "cioran-commands.h"
+#include "cioran-vulkan.h"
+
+
+namespace cioran {
+    VkCommandBuffer WorkerCommandPool::next_secondary(VkDevice device)
+    {
+        if (used == secondaries.size()) {
+            secondaries.push_back(create_secondary_command_buffer(device, pool));
+        }
+
+        return secondaries[used++];
+    }
+
+    void FrameCommands::init(VkDevice device, uint32_t queue_family_index, uint32_t worker_count)
+    {
+        // The pools are reset as a whole, so they don't need to support resetting individual command buffers.
+        // The transient bit hints that the command buffers are short lived, which lets the driver pick a better allocation strategy.
+        primary_pool = create_command_pool(device, queue_family_index, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        primary = create_command_buffer(device, primary_pool);
+
+        workers.resize(worker_count);
+        for (WorkerCommandPool& worker : workers) {
+            worker.pool = create_command_pool(device, queue_family_index, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+            worker.used = 0;
+        }
+    }
+
+    void FrameCommands::destroy(VkDevice device)
+    {
+        // Destroying the pools will also destroy the command buffers allocated from them
+        vkDestroyCommandPool(device, primary_pool, nullptr);
+
+        for (WorkerCommandPool& worker : workers) {
+            vkDestroyCommandPool(device, worker.pool, nullptr);
+        }
+        workers.clear();
+    }
+
+    void FrameCommands::reset(VkDevice device)
+    {
+        if (vkResetCommandPool(device, primary_pool, 0) != VK_SUCCESS) {
+            std::cout << "Failed to reset command pool" << std::endl;
+            std::terminate();
+        }
+
+        for (WorkerCommandPool& worker : workers) {
+            if (vkResetCommandPool(device, worker.pool, 0) != VK_SUCCESS) {
+                std::cout << "Failed to reset command pool" << std::endl;
+                std::terminate();
+            }
+            worker.used = 0;
+        }
+    }
+
+    std::vector<VkCommandBuffer> FrameCommands::record_parallel(VkDevice device, JobSystem& jobs, std::span<RecordTask> tasks)
+    {
+        std::vector<VkCommandBuffer> recorded(tasks.size());
+
+        // Each task is its own job, so idle threads can steal tasks from busy ones.
+        // A thread only ever runs one job at a time, so the pool that belongs to the thread running the job is ours alone.
+        jobs.parallel_for((uint32_t)tasks.size(), 1, [&](uint32_t begin, uint32_t end) {
+            // Jobs only run on threads of the job system, and there is a pool for each of them.
+            int thread_index = JobSystem::current_thread_index();
+            if (thread_index < 0 || thread_index >= (int)workers.size()) {
+                std::cout << "Failed to find a command pool for job thread " << thread_index << std::endl;
+                std::terminate();
+            }
+            WorkerCommandPool& worker = workers[thread_index];
+
+            for (uint32_t i = begin; i < end; i++) {
+                VkCommandBuffer cmd = worker.next_secondary(device);
+
+                // Secondary command buffers have to describe what they inherit from the primary.
+                // We don't record inside of a render pass, so there is nothing to inherit.
+                VkCommandBufferInheritanceInfo inheritance_info {};
+                inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+
+                VkCommandBufferBeginInfo begin_info {};
+                begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                begin_info.pInheritanceInfo = &inheritance_info;
+
+                if (vkBeginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
+                    std::cout << "Failed to begin secondary command buffer" << std::endl;
+                    std::terminate();
+                }
+
+                tasks[i](cmd);
+
+                if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+                    std::cout << "Failed to end secondary command buffer" << std::endl;
+                    std::terminate();
+                }
+
+                recorded[i] = cmd;
+            }
+        });
+
+        return recorded;
+    }
+
+    VkCommandBuffer create_secondary_command_buffer(VkDevice logicalDevice, VkCommandPool command_pool)
+    {
+        // Secondary command buffers can't be submitted on their own, they are executed from a primary command buffer.
+        VkCommandBufferAllocateInfo commandBufferInfo {};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferInfo.commandPool = command_pool;
+        commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        commandBufferInfo.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer;
+        if (vkAllocateCommandBuffers(logicalDevice, &commandBufferInfo, &command_buffer) != VK_SUCCESS) {
+            std::cout << "Failed to allocate secondary command buffer" << std::endl;
+            std::terminate();
+        }
+
+        return command_buffer;
+    }
+}
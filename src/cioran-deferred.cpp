@@ -0,0 +1,206 @@
+#include "cioran-deferred.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace cioran {
+    void DeferredDestroyer::init(VkDevice device, VmaAllocator allocator, uint32_t bucket_capacity)
+    {
+        this->device = device;
+        this->allocator = allocator;
+        this->bucket_capacity = bucket_capacity;
+
+        for (Bucket& bucket : buckets) {
+            bucket.epoch = 0;
+            bucket.count = 0;
+            bucket.writers = 0;
+            bucket.handles = std::make_unique<RetiredHandle[]>(bucket_capacity);
+        }
+
+        current_epoch = 0;
+    }
+
+    void DeferredDestroyer::destroy()
+    {
+        for (Bucket& bucket : buckets) {
+            destroy_bucket(bucket);
+            bucket.handles.reset();
+        }
+    }
+
+    void DeferredDestroyer::begin_epoch(uint64_t epoch)
+    {
+        // The bucket was last used DEFERRED_EPOCH_COUNT epochs ago, which the GPU has finished by now.
+        // It is normally empty already, but if collecting fell behind it is emptied here before it is reused.
+        Bucket& bucket = buckets[epoch % DEFERRED_EPOCH_COUNT];
+
+        // Starting the current epoch again, for example when a frame was skipped, changes nothing.
+        if (bucket.epoch.load() == epoch) {
+            return;
+        }
+
+        while (bucket.writers.load() != 0) {
+            std::this_thread::yield();
+        }
+        destroy_bucket(bucket);
+
+        bucket.epoch.store(epoch);
+        current_epoch.store(epoch);
+    }
+
+    void DeferredDestroyer::collect(uint64_t completed_epoch)
+    {
+        uint64_t epoch = current_epoch.load();
+
+        for (Bucket& bucket : buckets) {
+            // The current epoch is still being retired into, so it can never be complete.
+            uint64_t bucket_epoch = bucket.epoch.load();
+            if (bucket_epoch > completed_epoch || bucket_epoch >= epoch) {
+                continue;
+            }
+
+            // A thread that started retiring into the bucket before the epoch moved on might still be writing.
+            // Any thread that starts after sees the new epoch, and goes to the current bucket instead.
+            while (bucket.writers.load() != 0) {
+                std::this_thread::yield();
+            }
+
+            destroy_bucket(bucket);
+        }
+    }
+
+    void DeferredDestroyer::retire(RetiredHandleType type, uint64_t handle, VmaAllocation allocation)
+    {
+        while (true) {
+            uint64_t epoch = current_epoch.load();
+            Bucket& bucket = buckets[epoch % DEFERRED_EPOCH_COUNT];
+
+            // Register as a writer first, and only then check that the epoch is still current.
+            // Either the collecting thread sees us as a writer and waits, or we see that the epoch moved on and retry.
+            bucket.writers.fetch_add(1);
+            if (current_epoch.load() != epoch) {
+                bucket.writers.fetch_sub(1);
+                continue;
+            }
+
+            uint32_t index = bucket.count.fetch_add(1);
+            if (index < bucket_capacity) {
+                bucket.handles[index] = { type, handle, allocation };
+            } else {
+                std::lock_guard<std::mutex> lock(bucket.overflow_mutex);
+                bucket.overflow.push_back({ type, handle, allocation });
+            }
+
+            bucket.writers.fetch_sub(1);
+            return;
+        }
+    }
+
+    void DeferredDestroyer::destroy_bucket(Bucket& bucket)
+    {
+        uint32_t count = std::min(bucket.count.load(), bucket_capacity);
+        for (uint32_t i = 0; i < count; i++) {
+            destroy_handle(bucket.handles[i]);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(bucket.overflow_mutex);
+            for (const RetiredHandle& retired : bucket.overflow) {
+                destroy_handle(retired);
+            }
+            bucket.overflow.clear();
+        }
+
+        bucket.count.store(0);
+    }
+
+    void DeferredDestroyer::destroy_handle(const RetiredHandle& retired)
+    {
+        switch (retired.type) {
+            case RetiredHandleType::image:
+                if (retired.allocation != VK_NULL_HANDLE) {
+                    vmaDestroyImage(allocator, (VkImage)retired.handle, retired.allocation);
+                } else {
+                    vkDestroyImage(device, (VkImage)retired.handle, nullptr);
+                }
+                break;
+            case RetiredHandleType::image_view:
+                vkDestroyImageView(device, (VkImageView)retired.handle, nullptr);
+                break;
+            case RetiredHandleType::buffer:
+                vmaDestroyBuffer(allocator, (VkBuffer)retired.handle, retired.allocation);
+                break;
+            case RetiredHandleType::allocation:
+                vmaFreeMemory(allocator, retired.allocation);
+                break;
+            case RetiredHandleType::sampler:
+                vkDestroySampler(device, (VkSampler)retired.handle, nullptr);
+                break;
+            case RetiredHandleType::pipeline:
+                vkDestroyPipeline(device, (VkPipeline)retired.handle, nullptr);
+                break;
+            case RetiredHandleType::pipeline_layout:
+                vkDestroyPipelineLayout(device, (VkPipelineLayout)retired.handle, nullptr);
+                break;
+            case RetiredHandleType::descriptor_set_layout:
+                vkDestroyDescriptorSetLayout(device, (VkDescriptorSetLayout)retired.handle, nullptr);
+                break;
+            case RetiredHandleType::descriptor_pool:
+                vkDestroyDescriptorPool(device, (VkDescriptorPool)retired.handle, nullptr);
+                break;
+            case RetiredHandleType::shader_module:
+                vkDestroyShaderModule(device, (VkShaderModule)retired.handle, nullptr);
+                break;
+        }
+    }
+
+    void DeferredDestroyer::retire_image(VkImage image, VmaAllocation allocation)
+    {
+        retire(RetiredHandleType::image, (uint64_t)image, allocation);
+    }
+
+    void DeferredDestroyer::retire_image_view(VkImageView image_view)
+    {
+        retire(RetiredHandleType::image_view, (uint64_t)image_view);
+    }
+
+    void DeferredDestroyer::retire_buffer(VkBuffer buffer, VmaAllocation allocation)
+    {
+        retire(RetiredHandleType::buffer, (uint64_t)buffer, allocation);
+    }
+
+    void DeferredDestroyer::retire_allocation(VmaAllocation allocation)
+    {
+        retire(RetiredHandleType::allocation, 0, allocation);
+    }
+
+    void DeferredDestroyer::retire_sampler(VkSampler sampler)
+    {
+        retire(RetiredHandleType::sampler, (uint64_t)sampler);
+    }
+
+    void DeferredDestroyer::retire_pipeline(VkPipeline pipeline)
+    {
+        retire(RetiredHandleType::pipeline, (uint64_t)pipeline);
+    }
+
+    void DeferredDestroyer::retire_pipeline_layout(VkPipelineLayout pipeline_layout)
+    {
+        retire(RetiredHandleType::pipeline_layout, (uint64_t)pipeline_layout);
+    }
+
+    void DeferredDestroyer::retire_descriptor_set_layout(VkDescriptorSetLayout layout)
+    {
+        retire(RetiredHandleType::descriptor_set_layout, (uint64_t)layout);
+    }
+
+    void DeferredDestroyer::retire_descriptor_pool(VkDescriptorPool pool)
+    {
+        retire(RetiredHandleType::descriptor_pool, (uint64_t)pool);
+    }
+
+    void DeferredDestroyer::retire_shader_module(VkShaderModule shader_module)
+    {
+        retire(RetiredHandleType::shader_module, (uint64_t)shader_module);
+    }
+}
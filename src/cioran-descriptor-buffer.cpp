@@ -0,0 +1,214 @@
+#include "cioran-descriptor-buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace cioran {
+    static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void DescriptorBufferFunctions::load(VkDevice device)
+    {
+        get_layout_size = (PFN_vkGetDescriptorSetLayoutSizeEXT)vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutSizeEXT");
+        get_binding_offset = (PFN_vkGetDescriptorSetLayoutBindingOffsetEXT)vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+        get_descriptor = (PFN_vkGetDescriptorEXT)vkGetDeviceProcAddr(device, "vkGetDescriptorEXT");
+        bind_buffers = (PFN_vkCmdBindDescriptorBuffersEXT)vkGetDeviceProcAddr(device, "vkCmdBindDescriptorBuffersEXT");
+        set_offsets = (PFN_vkCmdSetDescriptorBufferOffsetsEXT)vkGetDeviceProcAddr(device, "vkCmdSetDescriptorBufferOffsetsEXT");
+
+        if (get_layout_size == nullptr || get_binding_offset == nullptr || get_descriptor == nullptr || bind_buffers == nullptr || set_offsets == nullptr) {
+            std::cout << "VK_EXT_descriptor_buffer is not enabled on the device" << std::endl;
+            std::terminate();
+        }
+    }
+
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT query_descriptor_buffer_properties(VkPhysicalDevice physical_device)
+    {
+        VkPhysicalDeviceDescriptorBufferPropertiesEXT properties = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT };
+        VkPhysicalDeviceProperties2 device_properties {};
+        device_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        device_properties.pNext = &properties;
+        vkGetPhysicalDeviceProperties2(physical_device, &device_properties);
+
+        return properties;
+    }
+
+    void DescriptorBufferAllocator::init(VkDevice device, VkPhysicalDevice physical_device, VmaAllocator allocator, VkDeviceSize capacity, VkBufferUsageFlags usage)
+    {
+        this->device = device;
+        functions.load(device);
+
+        // The size of each kind of descriptor, and the alignment of sets in the buffer, differ between devices.
+        properties = query_descriptor_buffer_properties(physical_device);
+
+        // A buffer that holds both kinds of descriptors has to fit both ranges.
+        if (usage & VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT) {
+            capacity = std::min(capacity, properties.maxResourceDescriptorBufferRange);
+        }
+        if (usage & VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT) {
+            capacity = std::min(capacity, properties.maxSamplerDescriptorBufferRange);
+        }
+
+        // Like the frame allocator, sequential writes let VMA pick device local memory the host can write to,
+        // so the GPU reads the descriptors without going over the bus.
+        buffer = create_buffer(allocator, capacity, usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_AUTO,
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        mapped = (uint8_t*)buffer.info.pMappedData;
+
+        VkBufferDeviceAddressInfo address_info {};
+        address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        address_info.buffer = buffer.buffer;
+        base_address = vkGetBufferDeviceAddress(device, &address_info);
+
+        this->usage = usage;
+        this->capacity = capacity;
+        head = 0;
+        layout_sizes.clear();
+    }
+
+    void DescriptorBufferAllocator::destroy(VmaAllocator allocator)
+    {
+        destroy_buffer(allocator, buffer);
+        mapped = nullptr;
+    }
+
+    void DescriptorBufferAllocator::reset()
+    {
+        head = 0;
+    }
+
+    DescriptorBufferSet DescriptorBufferAllocator::allocate(VkDescriptorSetLayout layout)
+    {
+        auto it = std::find_if(layout_sizes.begin(), layout_sizes.end(), [&](const auto& entry) { return entry.first == layout; });
+        VkDeviceSize size;
+        if (it != layout_sizes.end()) {
+            size = it->second;
+        } else {
+            functions.get_layout_size(device, layout, &size);
+            layout_sizes.push_back({ layout, size });
+        }
+
+        VkDeviceSize offset = align_up(head, properties.descriptorBufferOffsetAlignment);
+
+        if (offset + size > capacity) {
+            std::cout << "Descriptor buffer is out of memory, " << capacity << " bytes per frame is not enough" << std::endl;
+            std::terminate();
+        }
+
+        head = offset + size;
+
+        return { layout, offset, mapped + offset };
+    }
+
+    void DescriptorBufferAllocator::write_descriptor(const DescriptorBufferSet& set, uint32_t binding, uint32_t array_element, const VkDescriptorGetInfoEXT& info, size_t descriptor_size)
+    {
+        // Array elements are packed one after another from the binding's offset.
+        VkDeviceSize binding_offset;
+        functions.get_binding_offset(device, set.layout, binding, &binding_offset);
+
+        functions.get_descriptor(device, &info, descriptor_size, set.pointer + binding_offset + array_element * descriptor_size);
+    }
+
+    void DescriptorBufferAllocator::write_storage_image(const DescriptorBufferSet& set, uint32_t binding, VkImageView view, uint32_t array_element)
+    {
+        // Storage images are always accessed in the general layout.
+        VkDescriptorImageInfo image_info { VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_GENERAL };
+
+        VkDescriptorGetInfoEXT info { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+        info.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        info.data.pStorageImage = &image_info;
+
+        write_descriptor(set, binding, array_element, info, properties.storageImageDescriptorSize);
+    }
+
+    void DescriptorBufferAllocator::write_sampled_image(const DescriptorBufferSet& set, uint32_t binding, VkImageView view, VkImageLayout layout, uint32_t array_element)
+    {
+        VkDescriptorImageInfo image_info { VK_NULL_HANDLE, view, layout };
+
+        VkDescriptorGetInfoEXT info { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+        info.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        info.data.pSampledImage = &image_info;
+
+        write_descriptor(set, binding, array_element, info, properties.sampledImageDescriptorSize);
+    }
+
+    void DescriptorBufferAllocator::write_sampler(const DescriptorBufferSet& set, uint32_t binding, VkSampler sampler, uint32_t array_element)
+    {
+        VkDescriptorGetInfoEXT info { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+        info.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+        info.data.pSampler = &sampler;
+
+        write_descriptor(set, binding, array_element, info, properties.samplerDescriptorSize);
+    }
+
+    void DescriptorBufferAllocator::write_combined_image_sampler(const DescriptorBufferSet& set, uint32_t binding, VkSampler sampler, VkImageView view, VkImageLayout layout, uint32_t array_element)
+    {
+        VkDescriptorImageInfo image_info { sampler, view, layout };
+
+        VkDescriptorGetInfoEXT info { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+        info.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        info.data.pCombinedImageSampler = &image_info;
+
+        write_descriptor(set, binding, array_element, info, properties.combinedImageSamplerDescriptorSize);
+    }
+
+    void DescriptorBufferAllocator::write_uniform_buffer(const DescriptorBufferSet& set, uint32_t binding, VkDeviceAddress address, VkDeviceSize range, uint32_t array_element)
+    {
+        VkDescriptorAddressInfoEXT address_info { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT };
+        address_info.address = address;
+        address_info.range = range;
+
+        VkDescriptorGetInfoEXT info { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+        info.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        info.data.pUniformBuffer = &address_info;
+
+        write_descriptor(set, binding, array_element, info, properties.uniformBufferDescriptorSize);
+    }
+
+    void DescriptorBufferAllocator::write_storage_buffer(const DescriptorBufferSet& set, uint32_t binding, VkDeviceAddress address, VkDeviceSize range, uint32_t array_element)
+    {
+        VkDescriptorAddressInfoEXT address_info { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT };
+        address_info.address = address;
+        address_info.range = range;
+
+        VkDescriptorGetInfoEXT info { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+        info.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        info.data.pStorageBuffer = &address_info;
+
+        write_descriptor(set, binding, array_element, info, properties.storageBufferDescriptorSize);
+    }
+
+    VkDescriptorBufferBindingInfoEXT DescriptorBufferAllocator::binding_info() const
+    {
+        // The usage has to match the usage the buffer was created with.
+        VkDescriptorBufferBindingInfoEXT info { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT };
+        info.address = base_address;
+        info.usage = usage;
+
+        return info;
+    }
+
+    void DescriptorBufferAllocator::bind_buffer(VkCommandBuffer cmd) const
+    {
+        VkDescriptorBufferBindingInfoEXT info = binding_info();
+        functions.bind_buffers(cmd, 1, &info);
+    }
+
+    void DescriptorBufferAllocator::bind_set(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index, const DescriptorBufferSet& set,
+        uint32_t buffer_index) const
+    {
+        // The set is read from the buffer bound at buffer_index, at the set's offset.
+        functions.set_offsets(cmd, bind_point, pipeline_layout, set_index, 1, &buffer_index, &set.offset);
+    }
+
+    void DescriptorBufferAllocator::flush(VmaAllocator allocator)
+    {
+        if (head > 0) {
+            vmaFlushAllocation(allocator, buffer.allocation, 0, head);
+        }
+    }
+}
@@ -1,15 +1,16 @@
 #include "cioran-descriptors.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace cioran {
-    void DescriptorLayoutBuilder::add_binding(uint32_t binding, VkDescriptorType type) {
+    void DescriptorLayoutBuilder::add_binding(uint32_t binding, VkDescriptorType type, uint32_t count) {
         // VkDescriptorSetLayoutBinding describes the binding index for a shader stage,
         // And the descriptor type that is bound to that index.
         // DescriptorCount is the number of descriptors contained in the binding.
         VkDescriptorSetLayoutBinding newbind {};
         newbind.binding = binding;
-        newbind.descriptorCount = 1;
+        newbind.descriptorCount = count;
         newbind.descriptorType = type;
 
         bindings.push_back(newbind);
@@ -34,60 +35,369 @@ namespace cioran {
 
         VkDescriptorSetLayout set;
         if (vkCreateDescriptorSetLayout(device, &info, nullptr, &set) != VK_SUCCESS) {
-            std::cerr << "Failed to create descriptor set layout" << std::endl;
+            std::cout << "Failed to create descriptor set layout" << std::endl;
             std::terminate();
         }
 
         return set;
     }
 
+    VkDescriptorSetLayout DescriptorLayoutBuilder::build(DescriptorLayoutCache& layout_cache, VkShaderStageFlags shader_flags, VkDescriptorSetLayoutCreateFlags flags,
+        std::span<const VkDescriptorBindingFlags> binding_flags)
+    {
+        return layout_cache.get(bindings, shader_flags, flags, binding_flags);
+    }
+
+    void DescriptorAllocator::init(VkDevice device, uint32_t initial_sets, std::span<const PoolSizeRatio> pool_ratios)
+    {
+        ratios.assign(pool_ratios.begin(), pool_ratios.end());
+        allocated_sets = 0;
+        allocated_descriptors.clear();
+
+        ready_pools.push_back(create_pool(device, initial_sets, ratios));
+
+        // The next pool is bigger, so a workload that outgrows the first pool needs few new ones.
+        sets_per_pool = std::min(initial_sets + initial_sets / 2, MAX_SETS_PER_POOL);
+    }
+
     // VkDescriptorPools are used to allocate descriptor sets, and the pool owns the storage
     // For the descriptor sets.
-    void DescriptorAllocator::init_pool(VkDevice device, uint32_t max_sets, std::span<PoolSizeRatio> pool_ratios)
+    VkDescriptorPool DescriptorAllocator::create_pool(VkDevice device, uint32_t set_count, std::span<const PoolSizeRatio> pool_ratios)
     {
         std::vector<VkDescriptorPoolSize> poolSizes;
         for (PoolSizeRatio ratio : pool_ratios) {
             poolSizes.push_back(VkDescriptorPoolSize{
                 .type = ratio.type,
-                .descriptorCount = uint32_t(ratio.ratio * max_sets)
+                .descriptorCount = std::max(uint32_t(ratio.ratio * set_count), 1u)
             });
         }
 
         VkDescriptorPoolCreateInfo pool_info = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
         pool_info.flags = 0;
-        pool_info.maxSets = max_sets;
+        pool_info.maxSets = set_count;
         pool_info.poolSizeCount = (uint32_t)poolSizes.size();
         pool_info.pPoolSizes = poolSizes.data();
 
-        vkCreateDescriptorPool(device, &pool_info, nullptr, &pool);
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+            std::cout << "Failed to create descriptor pool" << std::endl;
+            std::terminate();
+        }
+
+        return pool;
+    }
+
+    VkDescriptorPool DescriptorAllocator::get_pool(VkDevice device)
+    {
+        if (!ready_pools.empty()) {
+            VkDescriptorPool pool = ready_pools.back();
+            ready_pools.pop_back();
+            return pool;
+        }
+
+        VkDescriptorPool pool = create_pool(device, sets_per_pool, ratios);
+        sets_per_pool = std::min(sets_per_pool + sets_per_pool / 2, MAX_SETS_PER_POOL);
+        return pool;
     }
 
-    VkDescriptorSet DescriptorAllocator::allocate(VkDevice device, VkDescriptorSetLayout layout)
+    VkDescriptorSet DescriptorAllocator::allocate(VkDevice device, VkDescriptorSetLayout layout, std::span<const VkDescriptorSetLayoutBinding> bindings, void* pNext)
     {
+        VkDescriptorPool pool = get_pool(device);
+
         VkDescriptorSetAllocateInfo alloc_info {};
         alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.pNext = pNext;
         alloc_info.descriptorPool = pool;
         alloc_info.descriptorSetCount = 1;
         alloc_info.pSetLayouts = &layout;
 
         // A VkDescriptorSet is an object that holds a collection of descriptors,
         // Which are used to link shader resources to the shaders in a Vulkan pipeline
-        VkDescriptorSet descriptor_set; 
-        if (vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set) != VK_SUCCESS) {
-            std::cerr << "Failed to allocate descriptor set" << std::endl;
+        VkDescriptorSet descriptor_set;
+        VkResult result = vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set);
+
+        // The pool is out of sets or descriptors, or too fragmented to fit the set.
+        // Either way it's full from now on, and the set goes into the next pool.
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+            full_pools.push_back(pool);
+
+            pool = get_pool(device);
+            alloc_info.descriptorPool = pool;
+            result = vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set);
+        }
+
+        // The set needs more descriptors than even a new pool has, like a big array. It gets a pool of its own, sized from its bindings.
+        // The pool holds nothing but the set, so it's full right away. The set is counted like any other,
+        // so the pool that clearing creates is sized for it, and this only happens once.
+        if ((result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) && !bindings.empty()) {
+            ready_pools.push_back(pool);
+
+            pool = create_pool(device, 1, set_pool_ratios(bindings));
+            alloc_info.descriptorPool = pool;
+            result = vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set);
+
+            if (result == VK_SUCCESS) {
+                full_pools.push_back(pool);
+                count_allocation(bindings);
+                return descriptor_set;
+            }
+        }
+
+        if (result != VK_SUCCESS) {
+            std::cout << "Failed to allocate descriptor set" << std::endl;
             std::terminate();
         }
 
+        ready_pools.push_back(pool);
+        count_allocation(bindings);
+
         return descriptor_set;
     }
 
-    void DescriptorAllocator::clear_descriptors(VkDevice device)
+    std::vector<DescriptorAllocator::PoolSizeRatio> DescriptorAllocator::set_pool_ratios(std::span<const VkDescriptorSetLayoutBinding> bindings)
     {
-        vkResetDescriptorPool(device, pool, 0);
+        std::vector<PoolSizeRatio> set_ratios;
+        for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+            auto it = std::find_if(set_ratios.begin(), set_ratios.end(), [&](const PoolSizeRatio& ratio) { return ratio.type == binding.descriptorType; });
+            if (it == set_ratios.end()) {
+                set_ratios.push_back({ binding.descriptorType, (float)binding.descriptorCount });
+            } else {
+                it->ratio += (float)binding.descriptorCount;
+            }
+        }
+
+        return set_ratios;
     }
 
-    void DescriptorAllocator::destroy_pool(VkDevice device)
+    void DescriptorAllocator::count_allocation(std::span<const VkDescriptorSetLayoutBinding> bindings)
     {
-        vkDestroyDescriptorPool(device, pool, nullptr);
+        allocated_sets++;
+
+        for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+            auto it = std::find_if(allocated_descriptors.begin(), allocated_descriptors.end(),
+                [&](const PoolSizeRatio& counted) { return counted.type == binding.descriptorType; });
+            if (it == allocated_descriptors.end()) {
+                allocated_descriptors.push_back({ binding.descriptorType, (float)binding.descriptorCount });
+            } else {
+                it->ratio += (float)binding.descriptorCount;
+            }
+        }
+    }
+
+    void DescriptorAllocator::clear_pools(VkDevice device)
+    {
+        // If everything fit into the pools that were already there, resetting them is all there is to do.
+        if (full_pools.empty()) {
+            for (VkDescriptorPool pool : ready_pools) {
+                vkResetDescriptorPool(device, pool, 0);
+            }
+        } else {
+            // The workload outgrew the pools. Replace them with a single pool sized for what was used, with some headroom,
+            // and with ratios that match the descriptor types that were actually allocated.
+            // Types that were never counted keep their old ratio, so sets allocated without their bindings still fit.
+            // The headroom is only added to the set count. The ratios are per set, so the descriptor counts grow with it.
+            uint32_t set_count = std::clamp(allocated_sets + allocated_sets / 4, 1u, MAX_SETS_PER_POOL);
+            for (const PoolSizeRatio& counted : allocated_descriptors) {
+                float ratio = counted.ratio / (float)allocated_sets;
+
+                auto it = std::find_if(ratios.begin(), ratios.end(), [&](const PoolSizeRatio& existing) { return existing.type == counted.type; });
+                if (it == ratios.end()) {
+                    ratios.push_back({ counted.type, ratio });
+                } else {
+                    it->ratio = ratio;
+                }
+            }
+
+            destroy_pools(device);
+            ready_pools.push_back(create_pool(device, set_count, ratios));
+            sets_per_pool = std::min(set_count + set_count / 2, MAX_SETS_PER_POOL);
+        }
+
+        allocated_sets = 0;
+        allocated_descriptors.clear();
+    }
+
+    void DescriptorAllocator::destroy_pools(VkDevice device)
+    {
+        for (VkDescriptorPool pool : ready_pools) {
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+        for (VkDescriptorPool pool : full_pools) {
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+
+        ready_pools.clear();
+        full_pools.clear();
+    }
+
+    void PushDescriptorFunctions::load(VkDevice device)
+    {
+        push_set = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetKHR");
+        push_set_with_template = (PFN_vkCmdPushDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetWithTemplateKHR");
+    }
+
+    void DescriptorWriter::write_image(uint32_t binding, VkImageView view, VkSampler sampler, VkImageLayout layout, VkDescriptorType type, uint32_t array_element)
+    {
+        VkDescriptorImageInfo& info = image_infos.emplace_back(VkDescriptorImageInfo {
+            .sampler = sampler,
+            .imageView = view,
+            .imageLayout = layout
+        });
+
+        VkWriteDescriptorSet write = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        write.dstBinding = binding;
+        write.dstArrayElement = array_element;
+        write.descriptorCount = 1;
+        write.descriptorType = type;
+        write.pImageInfo = &info;
+
+        writes.push_back(write);
+    }
+
+    void DescriptorWriter::write_buffer(uint32_t binding, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset, VkDescriptorType type, uint32_t array_element)
+    {
+        VkDescriptorBufferInfo& info = buffer_infos.emplace_back(VkDescriptorBufferInfo {
+            .buffer = buffer,
+            .offset = offset,
+            .range = size
+        });
+
+        VkWriteDescriptorSet write = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        write.dstBinding = binding;
+        write.dstArrayElement = array_element;
+        write.descriptorCount = 1;
+        write.descriptorType = type;
+        write.pBufferInfo = &info;
+
+        writes.push_back(write);
+    }
+
+    void DescriptorWriter::update_set(VkDescriptorSet set)
+    {
+        for (size_t i = first_unassigned_write; i < writes.size(); i++) {
+            writes[i].dstSet = set;
+        }
+
+        first_unassigned_write = writes.size();
+    }
+
+    void DescriptorWriter::flush(VkDevice device)
+    {
+        if (first_unassigned_write > 0) {
+            vkUpdateDescriptorSets(device, (uint32_t)first_unassigned_write, writes.data(), 0, nullptr);
+        }
+
+        clear();
+    }
+
+    void DescriptorWriter::push(VkCommandBuffer cmd, const PushDescriptorFunctions& functions, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index)
+    {
+        if (!functions.supported()) {
+            std::cout << "Push descriptors are not enabled on the device" << std::endl;
+            std::terminate();
+        }
+
+        // The writes are copied into the command buffer, so they are done with right away.
+        uint32_t count = (uint32_t)(writes.size() - first_unassigned_write);
+        if (count > 0) {
+            functions.push_set(cmd, bind_point, pipeline_layout, set_index, count, writes.data() + first_unassigned_write);
+        }
+
+        // Each write has one info, and the pushed writes are the newest, so their infos are the newest in the deques.
+        // Dropping them along with the writes keeps a writer that pushes for every dispatch from growing until it's cleared.
+        // Removing from the back of a deque leaves the infos of the writes that are still waiting for a set where they are.
+        size_t image_count = 0;
+        size_t buffer_count = 0;
+        for (size_t i = first_unassigned_write; i < writes.size(); i++) {
+            if (writes[i].pImageInfo != nullptr) {
+                image_count++;
+            } else if (writes[i].pBufferInfo != nullptr) {
+                buffer_count++;
+            }
+        }
+
+        image_infos.resize(image_infos.size() - image_count);
+        buffer_infos.resize(buffer_infos.size() - buffer_count);
+        writes.resize(first_unassigned_write);
+    }
+
+    void DescriptorWriter::clear()
+    {
+        image_infos.clear();
+        buffer_infos.clear();
+        writes.clear();
+        first_unassigned_write = 0;
+    }
+
+    VkDescriptorUpdateTemplateEntry update_template_entry(uint32_t binding, VkDescriptorType type, size_t offset, size_t stride, uint32_t count, uint32_t array_element)
+    {
+        VkDescriptorUpdateTemplateEntry entry {};
+        entry.dstBinding = binding;
+        entry.dstArrayElement = array_element;
+        entry.descriptorCount = count;
+        entry.descriptorType = type;
+        entry.offset = offset;
+        entry.stride = stride;
+
+        return entry;
+    }
+
+    void DescriptorUpdateTemplate::init(VkDevice device, VkDescriptorSetLayout layout, std::span<const VkDescriptorUpdateTemplateEntry> entries)
+    {
+        VkDescriptorUpdateTemplateCreateInfo info = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO };
+        info.descriptorUpdateEntryCount = (uint32_t)entries.size();
+        info.pDescriptorUpdateEntries = entries.data();
+        info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        info.descriptorSetLayout = layout;
+
+        if (vkCreateDescriptorUpdateTemplate(device, &info, nullptr, &update_template) != VK_SUCCESS) {
+            std::cout << "Failed to create descriptor update template" << std::endl;
+            std::terminate();
+        }
+
+        pipeline_layout = VK_NULL_HANDLE;
+        set_index = 0;
+    }
+
+    void DescriptorUpdateTemplate::init_push(VkDevice device, VkDescriptorSetLayout layout, std::span<const VkDescriptorUpdateTemplateEntry> entries,
+        VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index)
+    {
+        // Push templates ignore the set layout, and take the layout of the set from the pipeline layout instead.
+        VkDescriptorUpdateTemplateCreateInfo info = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO };
+        info.descriptorUpdateEntryCount = (uint32_t)entries.size();
+        info.pDescriptorUpdateEntries = entries.data();
+        info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+        info.descriptorSetLayout = layout;
+        info.pipelineBindPoint = bind_point;
+        info.pipelineLayout = pipeline_layout;
+        info.set = set_index;
+
+        if (vkCreateDescriptorUpdateTemplate(device, &info, nullptr, &update_template) != VK_SUCCESS) {
+            std::cout << "Failed to create push descriptor update template" << std::endl;
+            std::terminate();
+        }
+
+        this->pipeline_layout = pipeline_layout;
+        this->set_index = set_index;
+    }
+
+    void DescriptorUpdateTemplate::destroy(VkDevice device)
+    {
+        vkDestroyDescriptorUpdateTemplate(device, update_template, nullptr);
+    }
+
+    void DescriptorUpdateTemplate::update(VkDevice device, VkDescriptorSet set, const void* data) const
+    {
+        vkUpdateDescriptorSetWithTemplate(device, set, update_template, data);
+    }
+
+    void DescriptorUpdateTemplate::push(VkCommandBuffer cmd, const PushDescriptorFunctions& functions, const void* data) const
+    {
+        if (!functions.supported()) {
+            std::cout << "Push descriptors are not enabled on the device" << std::endl;
+            std::terminate();
+        }
+
+        functions.push_set_with_template(cmd, update_template, pipeline_layout, set_index, data);
     }
 }
\ No newline at end of file
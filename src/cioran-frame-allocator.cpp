@@ -0,0 +1,63 @@
+#include "cioran-frame-allocator.h"
+
+#include <algorithm>
+
+namespace cioran {
+    static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void FrameAllocator::init(VkDevice device, VmaAllocator allocator, VkDeviceSize capacity, const VkPhysicalDeviceLimits& limits)
+    {
+        // Sequential writes let VMA pick device local memory that the host can write to, where the device has it.
+        // The GPU then reads the constants without going over the bus.
+        buffer = create_buffer(allocator, capacity,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_AUTO,
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        mapped = (uint8_t*)buffer.info.pMappedData;
+
+        VkBufferDeviceAddressInfo address_info {};
+        address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        address_info.buffer = buffer.buffer;
+        base_address = vkGetBufferDeviceAddress(device, &address_info);
+
+        this->capacity = capacity;
+        head = 0;
+        min_alignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+    }
+
+    void FrameAllocator::destroy(VmaAllocator allocator)
+    {
+        destroy_buffer(allocator, buffer);
+        mapped = nullptr;
+    }
+
+    void FrameAllocator::reset()
+    {
+        head = 0;
+    }
+
+    FrameAllocation FrameAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        VkDeviceSize offset = align_up(head, std::max(alignment, min_alignment));
+
+        if (offset + size > capacity) {
+            std::cout << "Frame allocator is out of memory, " << capacity << " bytes per frame is not enough" << std::endl;
+            std::terminate();
+        }
+
+        head = offset + size;
+
+        return { buffer.buffer, offset, mapped + offset, base_address + offset };
+    }
+
+    void FrameAllocator::flush(VmaAllocator allocator)
+    {
+        if (head > 0) {
+            vmaFlushAllocation(allocator, buffer.allocation, 0, head);
+        }
+    }
+}
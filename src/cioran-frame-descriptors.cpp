@@ -0,0 +1,225 @@
+#include "cioran-frame-descriptors.h"
+
+#include <iostream>
+
+namespace cioran {
+    void DispatchSetLayout::add_binding(uint32_t binding, VkDescriptorType type, size_t offset)
+    {
+        bindings.push_back({ binding, type, 1, 0, nullptr });
+
+        // One descriptor per binding, so the stride is never used.
+        size_t stride = (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+            ? sizeof(VkDescriptorBufferInfo)
+            : sizeof(VkDescriptorImageInfo);
+        entries.push_back(update_template_entry(binding, type, offset, stride));
+    }
+
+    void DispatchSetLayout::build(VkDevice device, DescriptorLayoutCache& layout_cache, VkShaderStageFlags stage_flags, DescriptorBackend backend)
+    {
+        this->backend = backend;
+
+        switch (backend) {
+            case DescriptorBackend::pool:
+                layout = layout_cache.get(bindings, stage_flags);
+                update_template.init(device, layout, entries);
+                break;
+            case DescriptorBackend::buffer:
+                // The frame's descriptor buffer is a resource buffer, so it can't hold samplers.
+                for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+                    if (binding.descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER || binding.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
+                        std::cout << "Samplers can't be in sets of the frame's descriptor buffer, use the bindless heap's samplers instead" << std::endl;
+                        std::terminate();
+                    }
+                }
+                layout = layout_cache.get(bindings, stage_flags, VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT);
+                break;
+            case DescriptorBackend::push:
+                // The push template needs the pipeline layout, which is built from this layout, so it's made in build_push_template().
+                layout = layout_cache.get(bindings, stage_flags, VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR);
+                break;
+        }
+    }
+
+    void DispatchSetLayout::build_push_template(VkDevice device, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index)
+    {
+        if (backend == DescriptorBackend::push) {
+            update_template.init_push(device, layout, entries, bind_point, pipeline_layout, set_index);
+        }
+    }
+
+    void DispatchSetLayout::destroy(VkDevice device)
+    {
+        if (backend != DescriptorBackend::buffer) {
+            update_template.destroy(device);
+        }
+    }
+
+    void FrameDescriptors::init(VkDevice device, VkPhysicalDevice physical_device, VmaAllocator allocator, DescriptorBackend backend,
+        std::span<const DescriptorAllocator::PoolSizeRatio> pool_ratios, const PushDescriptorFunctions* push_functions)
+    {
+        this->device = device;
+        this->backend = backend;
+        this->push_functions = push_functions;
+
+        switch (backend) {
+            case DescriptorBackend::pool:
+                pool.init(device, DescriptorAllocator::INITIAL_SETS_PER_POOL, pool_ratios);
+                break;
+            case DescriptorBackend::buffer:
+                buffer.init(device, physical_device, allocator);
+                break;
+            case DescriptorBackend::push:
+                if (push_functions == nullptr || !push_functions->supported()) {
+                    std::cout << "Push descriptors are not enabled on the device" << std::endl;
+                    std::terminate();
+                }
+                break;
+        }
+    }
+
+    void FrameDescriptors::destroy(VmaAllocator allocator)
+    {
+        switch (backend) {
+            case DescriptorBackend::pool:
+                pool.destroy_pools(device);
+                break;
+            case DescriptorBackend::buffer:
+                buffer.destroy(allocator);
+                break;
+            case DescriptorBackend::push:
+                break;
+        }
+    }
+
+    void FrameDescriptors::reset()
+    {
+        switch (backend) {
+            case DescriptorBackend::pool:
+                pool.clear_pools(device);
+                break;
+            case DescriptorBackend::buffer:
+                buffer.reset();
+                break;
+            case DescriptorBackend::push:
+                break;
+        }
+    }
+
+    void FrameDescriptors::flush(VmaAllocator allocator)
+    {
+        // Pool sets are written by the driver, and pushed sets are recorded into the command buffer, so there is nothing to flush.
+        if (backend == DescriptorBackend::buffer) {
+            buffer.flush(allocator);
+        }
+    }
+
+    DispatchSet FrameDescriptors::write(const DispatchSetLayout& layout, const void* data)
+    {
+        DispatchSet set {};
+
+        switch (backend) {
+            case DescriptorBackend::pool:
+                set.set = pool.allocate(device, layout.layout, layout.bindings);
+                layout.update_template.update(device, set.set, data);
+                break;
+            case DescriptorBackend::buffer:
+                set.buffer_set = buffer.allocate(layout.layout);
+                for (const VkDescriptorUpdateTemplateEntry& entry : layout.entries) {
+                    write_buffer_descriptor(set.buffer_set, entry, (const uint8_t*)data);
+                }
+                break;
+            case DescriptorBackend::push:
+                // Pushed when the set is bound, straight from the struct.
+                set.push_template = &layout.update_template;
+                set.data = data;
+                break;
+        }
+
+        return set;
+    }
+
+    void FrameDescriptors::write_buffer_descriptor(const DescriptorBufferSet& set, const VkDescriptorUpdateTemplateEntry& entry, const uint8_t* data)
+    {
+        const uint8_t* descriptor = data + entry.offset;
+
+        switch (entry.descriptorType) {
+            case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: {
+                const VkDescriptorImageInfo& info = *(const VkDescriptorImageInfo*)descriptor;
+                buffer.write_storage_image(set, entry.dstBinding, info.imageView);
+                break;
+            }
+            case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: {
+                const VkDescriptorImageInfo& info = *(const VkDescriptorImageInfo*)descriptor;
+                buffer.write_sampled_image(set, entry.dstBinding, info.imageView, info.imageLayout);
+                break;
+            }
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: {
+                // Descriptor buffers reference buffers by their device address, and need the actual range.
+                const VkDescriptorBufferInfo& info = *(const VkDescriptorBufferInfo*)descriptor;
+                if (info.range == VK_WHOLE_SIZE) {
+                    std::cout << "Buffers in a descriptor buffer need an explicit range" << std::endl;
+                    std::terminate();
+                }
+
+                VkBufferDeviceAddressInfo address_info {};
+                address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+                address_info.buffer = info.buffer;
+                VkDeviceAddress address = vkGetBufferDeviceAddress(device, &address_info) + info.offset;
+
+                if (entry.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+                    buffer.write_uniform_buffer(set, entry.dstBinding, address, info.range);
+                } else {
+                    buffer.write_storage_buffer(set, entry.dstBinding, address, info.range);
+                }
+                break;
+            }
+            default:
+                std::cout << "Descriptor type " << entry.descriptorType << " isn't supported in the frame's descriptor buffer" << std::endl;
+                std::terminate();
+        }
+    }
+
+    void FrameDescriptors::bind_heap(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, const BindlessHeap& heap) const
+    {
+        switch (backend) {
+            case DescriptorBackend::pool:
+            case DescriptorBackend::push:
+                // Push descriptors and regular sets can be used together, so the heap stays a regular set.
+                heap.bind(cmd, bind_point, pipeline_layout);
+                break;
+            case DescriptorBackend::buffer: {
+                // Binding descriptor buffers replaces whatever was bound before, so both go in one call.
+                VkDescriptorBufferBindingInfoEXT binding_infos[] = { heap.descriptor_buffer.binding_info(), buffer.binding_info() };
+                buffer.functions.bind_buffers(cmd, 2, binding_infos);
+                heap.descriptor_buffer.bind_set(cmd, bind_point, pipeline_layout, 0, heap.buffer_set, HEAP_BUFFER_INDEX);
+                break;
+            }
+        }
+    }
+
+    void FrameDescriptors::bind(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index, const DispatchSet& set) const
+    {
+        switch (backend) {
+            case DescriptorBackend::pool:
+                vkCmdBindDescriptorSets(cmd, bind_point, pipeline_layout, set_index, 1, &set.set, 0, nullptr);
+                break;
+            case DescriptorBackend::buffer:
+                buffer.bind_set(cmd, bind_point, pipeline_layout, set_index, set.buffer_set, FRAME_BUFFER_INDEX);
+                break;
+            case DescriptorBackend::push:
+                // The template knows the pipeline layout and set index it pushes to, which have to be the ones given here.
+                set.push_template->push(cmd, *push_functions, set.data);
+                break;
+        }
+    }
+
+    bool supports_frame_descriptor_buffers(VkPhysicalDevice physical_device)
+    {
+        // The heap's buffer holds samplers and resources, and the frame's only resources, so two resource buffers are bound at once.
+        VkPhysicalDeviceDescriptorBufferPropertiesEXT properties = query_descriptor_buffer_properties(physical_device);
+        return properties.maxDescriptorBufferBindings >= 2
+            && properties.maxResourceDescriptorBufferBindings >= 2
+            && properties.maxSamplerDescriptorBufferBindings >= 1;
+    }
+}
@@ -0,0 +1,311 @@
+#include "cioran-jobs.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace cioran {
+    thread_local int job_thread_index = -1;
+
+    // How many times a waiting thread looks for work before it blocks on the job it waits for,
+    // and how long it blocks before it looks again, in case jobs were queued in the meantime.
+    constexpr uint32_t WAIT_SPIN_ROUNDS { 64 };
+    constexpr std::chrono::microseconds WAIT_BLOCK_INTERVAL { 200 };
+
+    void JobSystem::init(uint32_t worker_count)
+    {
+        if (worker_count == 0) {
+            uint32_t hardware_threads = std::thread::hardware_concurrency();
+            worker_count = hardware_threads > 1 ? hardware_threads - 1 : 0;
+        }
+
+        work_generation = 0;
+        stopping = false;
+        next_queue = 0;
+
+        // One queue for the calling thread, and one for each worker
+        queues.clear();
+        for (uint32_t i = 0; i < worker_count + 1; i++) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+
+        job_thread_index = 0;
+
+        for (uint32_t i = 1; i <= worker_count; i++) {
+            workers.emplace_back(&JobSystem::worker_main, this, (int)i);
+        }
+    }
+
+    void JobSystem::shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        sleep_condition.notify_all();
+
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        workers.clear();
+        queues.clear();
+    }
+
+    uint32_t JobSystem::thread_count() const
+    {
+        return (uint32_t)queues.size();
+    }
+
+    int JobSystem::current_thread_index()
+    {
+        return job_thread_index;
+    }
+
+    JobHandle JobSystem::schedule(Job job, std::span<const JobHandle> dependencies)
+    {
+        JobHandle handle = std::make_shared<JobState>();
+        handle->job = std::move(job);
+        handle->finished = false;
+        handle->remaining_dependencies = (uint32_t)dependencies.size() + 1;
+
+        for (const JobHandle& dependency : dependencies) {
+            std::lock_guard<std::mutex> lock(dependency->mutex);
+            if (dependency->finished) {
+                handle->remaining_dependencies--;
+            } else {
+                dependency->dependents.push_back(handle);
+            }
+        }
+
+        // Drop the count held while registering. If every dependency has already finished, the job can run right away.
+        if (--handle->remaining_dependencies == 0) {
+            enqueue(handle);
+        }
+
+        return handle;
+    }
+
+    void JobSystem::wait(const JobHandle& handle)
+    {
+        // A thread outside of the job system has no deque of its own. It must not run jobs either,
+        // as jobs may rely on running on a job thread (like the per thread command pools), so it only blocks.
+        int thread_index = current_thread_index();
+        if (thread_index < 0) {
+            std::unique_lock<std::mutex> lock(handle->mutex);
+            handle->finished_condition.wait(lock, [&]() { return handle->finished; });
+            return;
+        }
+
+        uint32_t idle_rounds = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(handle->mutex);
+                if (handle->finished) {
+                    return;
+                }
+
+                // Nothing to run for a while means the job, or what it depends on, is running on another thread.
+                // Spinning would only take CPU time away from it.
+                if (idle_rounds >= WAIT_SPIN_ROUNDS) {
+                    if (handle->finished_condition.wait_for(lock, WAIT_BLOCK_INTERVAL, [&]() { return handle->finished; })) {
+                        return;
+                    }
+                }
+            }
+
+            if (run_one(thread_index)) {
+                idle_rounds = 0;
+            } else {
+                idle_rounds++;
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void JobSystem::parallel_for(uint32_t count, uint32_t grain_size, const std::function<void(uint32_t, uint32_t)>& fn)
+    {
+        grain_size = std::max(grain_size, 1u);
+
+        std::vector<JobHandle> chunks;
+        for (uint32_t begin = 0; begin < count; begin += grain_size) {
+            uint32_t end = std::min(begin + grain_size, count);
+            chunks.push_back(schedule([&fn, begin, end]() { fn(begin, end); }));
+        }
+
+        // Wait in reverse order. The last chunk is at the back of our own deque, so we pick it up first,
+        // while the other threads steal from the front.
+        for (auto it = chunks.rbegin(); it != chunks.rend(); it++) {
+            wait(*it);
+        }
+    }
+
+    void JobSystem::enqueue(JobHandle handle)
+    {
+        int thread_index = current_thread_index();
+        if (thread_index < 0 || thread_index >= (int)queues.size()) {
+            thread_index = (int)(next_queue++ % queues.size());
+        }
+
+        {
+            WorkerQueue& queue = *queues[thread_index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(handle));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            work_generation++;
+        }
+        sleep_condition.notify_one();
+    }
+
+    bool JobSystem::run_one(int thread_index)
+    {
+        JobHandle handle;
+
+        // Take the newest job from our own deque
+        {
+            WorkerQueue& queue = *queues[thread_index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty()) {
+                handle = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            }
+        }
+
+        // Otherwise steal the oldest job from one of the other deques
+        for (size_t i = 1; handle == nullptr && i < queues.size(); i++) {
+            WorkerQueue& victim = *queues[(thread_index + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                handle = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+            }
+        }
+
+        if (handle == nullptr) {
+            return false;
+        }
+
+        handle->job();
+        finish(handle);
+
+        return true;
+    }
+
+    void JobSystem::finish(const JobHandle& handle)
+    {
+        std::vector<JobHandle> dependents;
+        {
+            std::lock_guard<std::mutex> lock(handle->mutex);
+            handle->finished = true;
+            dependents.swap(handle->dependents);
+        }
+        handle->finished_condition.notify_all();
+
+        // Release the captures of the job as soon as it's done
+        handle->job = nullptr;
+
+        for (JobHandle& dependent : dependents) {
+            if (--dependent->remaining_dependencies == 0) {
+                enqueue(std::move(dependent));
+            }
+        }
+    }
+
+    void JobSystem::worker_main(int thread_index)
+    {
+        job_thread_index = thread_index;
+
+        while (true) {
+            uint64_t generation = work_generation;
+
+            if (run_one(thread_index)) {
+                continue;
+            }
+
+            // Sleep until new work is queued. If work was queued after we read the generation, we don't sleep at all.
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_condition.wait(lock, [&]() { return stopping || work_generation != generation; });
+
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    void BackgroundQueue::init()
+    {
+        stopping = false;
+        thread = std::thread(&BackgroundQueue::thread_main, this);
+    }
+
+    void BackgroundQueue::shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_one();
+
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    JobHandle BackgroundQueue::schedule(Job job)
+    {
+        JobHandle handle = std::make_shared<JobState>();
+        handle->job = std::move(job);
+        handle->finished = false;
+        handle->remaining_dependencies = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(handle);
+        }
+        condition.notify_one();
+
+        return handle;
+    }
+
+    void BackgroundQueue::wait(const JobHandle& handle)
+    {
+        std::unique_lock<std::mutex> lock(handle->mutex);
+        handle->finished_condition.wait(lock, [&]() { return handle->finished; });
+    }
+
+    bool BackgroundQueue::is_finished(const JobHandle& handle)
+    {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        return handle->finished;
+    }
+
+    void BackgroundQueue::thread_main()
+    {
+        while (true) {
+            JobHandle handle;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [&]() { return stopping || !jobs.empty(); });
+
+                // Jobs that were queued before shutdown still run, so nothing waiting on them is left hanging.
+                if (jobs.empty()) {
+                    return;
+                }
+
+                handle = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            handle->job();
+            handle->job = nullptr;
+
+            {
+                std::lock_guard<std::mutex> lock(handle->mutex);
+                handle->finished = true;
+            }
+            handle->finished_condition.notify_all();
+        }
+    }
+}
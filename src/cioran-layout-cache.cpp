@@ -0,0 +1,173 @@
+#include "cioran-layout-cache.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace cioran {
+    // FNV-1a style mixing of 32 and 64 bit values into a hash.
+    static void hash_combine(uint64_t& hash, uint64_t value)
+    {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    }
+
+    bool DescriptorLayoutKey::operator==(const DescriptorLayoutKey& other) const
+    {
+        if (flags != other.flags || bindings.size() != other.bindings.size() || binding_flags != other.binding_flags) {
+            return false;
+        }
+
+        for (size_t i = 0; i < bindings.size(); i++) {
+            const VkDescriptorSetLayoutBinding& a = bindings[i];
+            const VkDescriptorSetLayoutBinding& b = other.bindings[i];
+            if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    uint64_t DescriptorLayoutKey::hash() const
+    {
+        uint64_t hash = 14695981039346656037ull;
+        hash_combine(hash, flags);
+        for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+            hash_combine(hash, binding.binding);
+            hash_combine(hash, binding.descriptorType);
+            hash_combine(hash, binding.descriptorCount);
+            hash_combine(hash, binding.stageFlags);
+        }
+        for (VkDescriptorBindingFlags binding_flag : binding_flags) {
+            hash_combine(hash, binding_flag);
+        }
+
+        return hash;
+    }
+
+    bool PipelineLayoutKey::operator==(const PipelineLayoutKey& other) const
+    {
+        if (set_layouts != other.set_layouts || push_constant_ranges.size() != other.push_constant_ranges.size()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < push_constant_ranges.size(); i++) {
+            const VkPushConstantRange& a = push_constant_ranges[i];
+            const VkPushConstantRange& b = other.push_constant_ranges[i];
+            if (a.stageFlags != b.stageFlags || a.offset != b.offset || a.size != b.size) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    uint64_t PipelineLayoutKey::hash() const
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (VkDescriptorSetLayout set_layout : set_layouts) {
+            hash_combine(hash, (uint64_t)set_layout);
+        }
+        for (const VkPushConstantRange& range : push_constant_ranges) {
+            hash_combine(hash, range.stageFlags);
+            hash_combine(hash, range.offset);
+            hash_combine(hash, range.size);
+        }
+
+        return hash;
+    }
+
+    void DescriptorLayoutCache::init(VkDevice device)
+    {
+        this->device = device;
+        table.init();
+    }
+
+    void DescriptorLayoutCache::destroy()
+    {
+        table.destroy([&](VkDescriptorSetLayout layout) {
+            vkDestroyDescriptorSetLayout(device, layout, nullptr);
+        });
+    }
+
+    VkDescriptorSetLayout DescriptorLayoutCache::get(std::span<const VkDescriptorSetLayoutBinding> bindings, VkShaderStageFlags stage_flags,
+        VkDescriptorSetLayoutCreateFlags flags, std::span<const VkDescriptorBindingFlags> binding_flags)
+    {
+        // Sort the bindings by binding number, so the same bindings given in another order are the same layout.
+        std::vector<uint32_t> order(bindings.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return bindings[a].binding < bindings[b].binding; });
+
+        DescriptorLayoutKey key {};
+        key.flags = flags;
+        for (uint32_t i : order) {
+            VkDescriptorSetLayoutBinding binding = bindings[i];
+            binding.stageFlags |= stage_flags;
+            binding.pImmutableSamplers = nullptr;
+            key.bindings.push_back(binding);
+
+            if (!binding_flags.empty()) {
+                key.binding_flags.push_back(binding_flags[i]);
+            }
+        }
+
+        return table.get_or_create(key.hash(), key, [&]() {
+            VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info {};
+            binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+            binding_flags_info.bindingCount = (uint32_t)key.binding_flags.size();
+            binding_flags_info.pBindingFlags = key.binding_flags.data();
+
+            VkDescriptorSetLayoutCreateInfo info {};
+            info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            info.pNext = key.binding_flags.empty() ? nullptr : &binding_flags_info;
+            info.pBindings = key.bindings.data();
+            info.bindingCount = (uint32_t)key.bindings.size();
+            info.flags = flags;
+
+            VkDescriptorSetLayout layout;
+            if (vkCreateDescriptorSetLayout(device, &info, nullptr, &layout) != VK_SUCCESS) {
+                std::cout << "Failed to create descriptor set layout" << std::endl;
+                std::terminate();
+            }
+
+            return layout;
+        });
+    }
+
+    void PipelineLayoutCache::init(VkDevice device)
+    {
+        this->device = device;
+        table.init();
+    }
+
+    void PipelineLayoutCache::destroy()
+    {
+        table.destroy([&](VkPipelineLayout layout) {
+            vkDestroyPipelineLayout(device, layout, nullptr);
+        });
+    }
+
+    VkPipelineLayout PipelineLayoutCache::get(std::span<const VkDescriptorSetLayout> set_layouts, std::span<const VkPushConstantRange> push_constant_ranges)
+    {
+        PipelineLayoutKey key {};
+        key.set_layouts.assign(set_layouts.begin(), set_layouts.end());
+        key.push_constant_ranges.assign(push_constant_ranges.begin(), push_constant_ranges.end());
+
+        return table.get_or_create(key.hash(), key, [&]() {
+            VkPipelineLayoutCreateInfo layout_info {};
+            layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            layout_info.setLayoutCount = (uint32_t)key.set_layouts.size();
+            layout_info.pSetLayouts = key.set_layouts.data();
+            layout_info.pushConstantRangeCount = (uint32_t)key.push_constant_ranges.size();
+            layout_info.pPushConstantRanges = key.push_constant_ranges.data();
+
+            VkPipelineLayout layout;
+            if (vkCreatePipelineLayout(device, &layout_info, nullptr, &layout) != VK_SUCCESS) {
+                std::cout << "Failed to create pipeline layout" << std::endl;
+                std::terminate();
+            }
+
+            return layout;
+        });
+    }
+}
@@ -0,0 +1,149 @@
+#include "cioran-pacing.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace cioran {
+    // How close to a deadline we stop sleeping and start spinning.
+    constexpr std::chrono::microseconds SPIN_THRESHOLD { 2000 };
+
+    // How much the just in time delay grows each frame that is displayed on time,
+    // and the fraction of a refresh interval it backs off when a frame is late.
+    constexpr std::chrono::microseconds DELAY_STEP { 100 };
+    constexpr int DELAY_BACKOFF_DIVISOR { 4 };
+
+    // Never wait more than this for a present, in case the presentation engine never reports it.
+    constexpr uint64_t PRESENT_WAIT_TIMEOUT_NS { 100000000 };
+
+    void precise_sleep_until(std::chrono::steady_clock::time_point deadline)
+    {
+        auto now = std::chrono::steady_clock::now();
+        while (deadline - now > SPIN_THRESHOLD) {
+            std::this_thread::sleep_for(deadline - now - SPIN_THRESHOLD);
+            now = std::chrono::steady_clock::now();
+        }
+
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+    }
+
+    void FramePacer::init(VkDevice device, bool present_wait_enabled, bool enable_just_in_time, uint32_t fps_limit, float refresh_rate_hz)
+    {
+        // vkWaitForPresentKHR is an extension function, so it's not exported by the loader and has to be fetched from the device.
+        wait_for_present = present_wait_enabled
+            ? (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR")
+            : nullptr;
+
+        just_in_time = enable_just_in_time && wait_for_present != nullptr;
+
+        limiter_interval = fps_limit > 0
+            ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps_limit))
+            : Clock::duration::zero();
+
+        if (refresh_rate_hz <= 0.0f) {
+            refresh_rate_hz = 60.0f;
+        }
+        refresh_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / refresh_rate_hz));
+        start_delay = Clock::duration::zero();
+
+        present_id = 0;
+        first_swapchain_present_id = 1;
+        last_displayed_id = 0;
+        last_display_time = Clock::now();
+        last_frame_start = last_display_time;
+        frame_starts.fill(last_display_time);
+
+        latency_ms = 0.0;
+        last_sampled_id = 0;
+        missed_frames = 0;
+    }
+
+    void FramePacer::on_swapchain_recreated()
+    {
+        first_swapchain_present_id = present_id + 1;
+        last_displayed_id = 0;
+        last_sampled_id = 0;
+        start_delay = Clock::duration::zero();
+    }
+
+    void FramePacer::wait_for_frame_start(VkDevice device, VkSwapchainKHR swapchain)
+    {
+        // Waiting for the frame before the last one means the previous frame can still be queued
+        // while we work on the next one, so the CPU and GPU keep overlapping.
+        if (wait_for_present != nullptr && present_id >= first_swapchain_present_id + 1) {
+            uint64_t wait_id = present_id - 1;
+
+            VkResult result = wait_for_present(device, swapchain, wait_id, PRESENT_WAIT_TIMEOUT_NS);
+            Clock::time_point display_time = Clock::now();
+
+            if (result == VK_SUCCESS && wait_id > last_displayed_id) {
+                latency_ms = std::chrono::duration<double, std::milli>(display_time - frame_starts[wait_id % HISTORY_SIZE]).count();
+
+                // Consecutive frames should be displayed one refresh apart. If the gap is much larger, the frame missed its vblank.
+                bool missed = false;
+                if (last_displayed_id != 0 && wait_id == last_displayed_id + 1) {
+                    auto interval = display_time - last_display_time;
+                    missed = interval > refresh_interval + refresh_interval / 2;
+
+                    // Refine the refresh interval from what we actually observe, as the display mode can be inaccurate.
+                    if (!missed) {
+                        refresh_interval = (refresh_interval * 7 + interval) / 8;
+                    }
+                }
+
+                if (just_in_time) {
+                    if (missed) {
+                        missed_frames++;
+                        start_delay = std::max(Clock::duration::zero(), start_delay - refresh_interval / DELAY_BACKOFF_DIVISOR);
+                    } else {
+                        // The previous frame is queued for the next vblank, so the next frame is displayed two refreshes from now.
+                        // We keep some margin, so the frame isn't started later than it can possibly finish.
+                        start_delay = std::min<Clock::duration>(start_delay + DELAY_STEP, refresh_interval * 2 - refresh_interval / DELAY_BACKOFF_DIVISOR);
+                    }
+                }
+
+                last_displayed_id = wait_id;
+                last_display_time = display_time;
+            }
+
+            if (just_in_time) {
+                precise_sleep_until(display_time + start_delay);
+            }
+        }
+
+        if (limiter_interval > Clock::duration::zero()) {
+            precise_sleep_until(last_frame_start + limiter_interval);
+        }
+    }
+
+    uint64_t FramePacer::begin_frame()
+    {
+        present_id++;
+        last_frame_start = Clock::now();
+        frame_starts[present_id % HISTORY_SIZE] = last_frame_start;
+
+        return present_id;
+    }
+
+    VkPresentIdKHR FramePacer::present_id_info(const uint64_t* id) const
+    {
+        VkPresentIdKHR info {};
+        info.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        info.swapchainCount = 1;
+        info.pPresentIds = id;
+
+        return info;
+    }
+
+    bool FramePacer::take_latency_sample(double& sample_ms)
+    {
+        if (wait_for_present == nullptr || last_displayed_id == 0 || last_displayed_id == last_sampled_id) {
+            return false;
+        }
+
+        last_sampled_id = last_displayed_id;
+        sample_ms = latency_ms;
+        return true;
+    }
+}
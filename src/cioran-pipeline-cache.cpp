@@ -0,0 +1,183 @@
+#include "cioran-pipeline-cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace cioran {
+    // FNV-1a. It's not cryptographic, but it's simple and good enough to tell a damaged file apart from a good one.
+    static uint64_t checksum(const char* data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= (uint8_t)data[i];
+            hash *= 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    void PipelineCache::init(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path)
+    {
+        this->device = device;
+        this->properties = properties;
+        this->path = path;
+
+        std::vector<char> data;
+        bool loaded = load_file(data);
+
+        VkPipelineCacheCreateInfo cache_info {};
+        cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cache_info.initialDataSize = loaded ? data.size() : 0;
+        cache_info.pInitialData = loaded ? data.data() : nullptr;
+
+        if (vkCreatePipelineCache(device, &cache_info, nullptr, &cache) != VK_SUCCESS) {
+            std::cout << "Failed to create pipeline cache" << std::endl;
+            std::terminate();
+        }
+
+        saved_data_size = loaded ? data.size() : 0;
+        last_save_time = std::chrono::steady_clock::now();
+        save_job = nullptr;
+
+        if (loaded) {
+            std::cout << "Pipeline cache: loaded " << data.size() << " bytes from " << path << std::endl;
+        } else {
+            std::cout << "Pipeline cache: starting empty" << std::endl;
+        }
+    }
+
+    void PipelineCache::destroy()
+    {
+        save();
+        vkDestroyPipelineCache(device, cache, nullptr);
+    }
+
+    bool PipelineCache::load_file(std::vector<char>& data)
+    {
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        size_t file_size = (size_t)file.tellg();
+        if (file_size < sizeof(PipelineCacheFileHeader)) {
+            std::cout << "Pipeline cache file is too small, ignoring it" << std::endl;
+            return false;
+        }
+
+        PipelineCacheFileHeader header;
+        file.seekg(0);
+        file.read((char*)&header, sizeof(header));
+
+        if (header.magic != PIPELINE_CACHE_MAGIC || header.file_version != PIPELINE_CACHE_FILE_VERSION) {
+            std::cout << "Pipeline cache file has an unknown format, ignoring it" << std::endl;
+            return false;
+        }
+
+        // A cache from another GPU, or from another version of the driver, is useless to this one.
+        // This is expected after a driver update, so the cache simply starts over.
+        if (header.vendor_id != properties.vendorID ||
+            header.device_id != properties.deviceID ||
+            header.driver_version != properties.driverVersion ||
+            std::memcmp(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+            std::cout << "Pipeline cache file is from another device or driver version, ignoring it" << std::endl;
+            return false;
+        }
+
+        if (header.data_size != file_size - sizeof(header)) {
+            std::cout << "Pipeline cache file is incomplete, ignoring it" << std::endl;
+            return false;
+        }
+
+        data.resize(header.data_size);
+        file.read(data.data(), header.data_size);
+        if (!file || checksum(data.data(), data.size()) != header.data_checksum) {
+            std::cout << "Pipeline cache file is damaged, ignoring it" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool PipelineCache::save()
+    {
+        // The driver appends new pipelines to the cache, so an unchanged size means there is nothing new to save.
+        size_t data_size = 0;
+        if (vkGetPipelineCacheData(device, cache, &data_size, nullptr) != VK_SUCCESS) {
+            std::cout << "Failed to get pipeline cache size" << std::endl;
+            return false;
+        }
+
+        if (data_size == saved_data_size) {
+            return true;
+        }
+
+        std::vector<char> data(data_size);
+        if (vkGetPipelineCacheData(device, cache, &data_size, data.data()) != VK_SUCCESS) {
+            std::cout << "Failed to get pipeline cache data" << std::endl;
+            return false;
+        }
+        data.resize(data_size);
+
+        PipelineCacheFileHeader header {};
+        header.magic = PIPELINE_CACHE_MAGIC;
+        header.file_version = PIPELINE_CACHE_FILE_VERSION;
+        header.vendor_id = properties.vendorID;
+        header.device_id = properties.deviceID;
+        header.driver_version = properties.driverVersion;
+        std::memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+        header.data_size = data.size();
+        header.data_checksum = checksum(data.data(), data.size());
+
+        // Write everything to a temporary file, and only replace the real file once the write has fully succeeded.
+        std::string temporary_path = path + ".tmp";
+        {
+            std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+            file.write((const char*)&header, sizeof(header));
+            file.write(data.data(), data.size());
+            file.close();
+
+            if (!file) {
+                std::cout << "Failed to write pipeline cache to " << temporary_path << std::endl;
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary_path, path, error);
+        if (error) {
+            std::cout << "Failed to replace pipeline cache " << path << ": " << error.message() << std::endl;
+            std::filesystem::remove(temporary_path, error);
+            return false;
+        }
+
+        saved_data_size = data.size();
+        return true;
+    }
+
+    void PipelineCache::save_periodically(BackgroundQueue& background)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_save_time < PIPELINE_CACHE_SAVE_INTERVAL) {
+            return;
+        }
+
+        // Don't start another save while the last one is still running.
+        if (save_job != nullptr && !BackgroundQueue::is_finished(save_job)) {
+            return;
+        }
+
+        last_save_time = now;
+        save_job = background.schedule([this]() { save(); });
+    }
+
+    void PipelineCache::wait_for_save()
+    {
+        if (save_job != nullptr) {
+            BackgroundQueue::wait(save_job);
+            save_job = nullptr;
+        }
+    }
+}
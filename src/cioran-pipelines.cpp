@@ -0,0 +1,276 @@
+#include "cioran-pipelines.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace cioran {
+    bool load_shader_module(VkDevice device, const char* file_path, VkShaderModule* out_shader_module)
+    {
+        // Open the file at the end, so the read position tells us the size of the file
+        std::ifstream file(file_path, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            std::cout << "Failed to open shader file " << file_path << std::endl;
+            return false;
+        }
+
+        // SPIR-V is a stream of 32 bit words, so the code is read into a buffer of uint32_t
+        size_t file_size = (size_t)file.tellg();
+        if (file_size == 0 || file_size % sizeof(uint32_t) != 0) {
+            std::cout << "Shader file " << file_path << " is not valid SPIR-V" << std::endl;
+            return false;
+        }
+
+        std::vector<uint32_t> buffer(file_size / sizeof(uint32_t));
+        file.seekg(0);
+        file.read((char*)buffer.data(), file_size);
+        file.close();
+
+        VkShaderModuleCreateInfo create_info {};
+        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        // The code size is in bytes
+        create_info.codeSize = buffer.size() * sizeof(uint32_t);
+        create_info.pCode = buffer.data();
+
+        VkShaderModule shader_module;
+        if (vkCreateShaderModule(device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
+            std::cout << "Failed to create shader module from " << file_path << std::endl;
+            return false;
+        }
+
+        *out_shader_module = shader_module;
+        return true;
+    }
+
+    ComputeDeviceInfo query_compute_device_info(VkPhysicalDevice physical_device)
+    {
+        VkPhysicalDeviceSubgroupProperties subgroup_properties {};
+        subgroup_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &subgroup_properties;
+        vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+        ComputeDeviceInfo info {};
+        info.vendor_id = properties.properties.vendorID;
+        info.device_type = properties.properties.deviceType;
+        info.subgroup_size = std::max(subgroup_properties.subgroupSize, 1u);
+        info.max_workgroup_size[0] = properties.properties.limits.maxComputeWorkGroupSize[0];
+        info.max_workgroup_size[1] = properties.properties.limits.maxComputeWorkGroupSize[1];
+        info.max_workgroup_size[2] = properties.properties.limits.maxComputeWorkGroupSize[2];
+        info.max_workgroup_invocations = properties.properties.limits.maxComputeWorkGroupInvocations;
+
+        return info;
+    }
+
+    WorkgroupSize choose_workgroup_size_2d(const ComputeDeviceInfo& device)
+    {
+        // Workgroup sizes that are known to work well for image kernels on each vendor's hardware.
+        // - NVIDIA runs warps of 32. 16x16 gives 8 warps per workgroup, enough to hide memory latency.
+        // - AMD runs wavefronts of 64 (or 32 on RDNA). 8x8 is a single wave64, which schedules with the least waste.
+        // - Intel runs SIMD8 to SIMD32. 8x8 maps to its threads without leaving lanes idle.
+        struct VendorTuning {
+            uint32_t vendor_id;
+            WorkgroupSize size;
+        };
+
+        constexpr VendorTuning tuning_table[] = {
+            { 0x10DE, { 16, 16 } }, // NVIDIA
+            { 0x1002, { 8, 8 } },   // AMD
+            { 0x8086, { 8, 8 } },   // Intel
+        };
+
+        WorkgroupSize size { 0, 0 };
+
+        // CPU implementations like lavapipe run a subgroup as one SIMD vector, so a row of a workgroup should be exactly one vector wide.
+        // A few rows give each workgroup enough work to be worth the overhead of scheduling it.
+        if (device.device_type == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+            size = { device.subgroup_size, 4 };
+        } else {
+            for (const VendorTuning& tuning : tuning_table) {
+                if (tuning.vendor_id == device.vendor_id) {
+                    size = tuning.size;
+                    break;
+                }
+            }
+        }
+
+        // Unknown GPUs get a square workgroup of 64 invocations, or of a single subgroup if that is larger,
+        // so no workgroup ever leaves part of a subgroup idle.
+        if (size.x == 0) {
+            uint32_t invocations = std::max(device.subgroup_size, 64u);
+            size.x = 1;
+            while (size.x * size.x < invocations) {
+                size.x *= 2;
+            }
+            size.y = invocations / size.x;
+        }
+
+        // Stay within the device's limits. Every device supports at least 128x128 with 128 invocations.
+        size.x = std::clamp(size.x, 1u, device.max_workgroup_size[0]);
+        size.y = std::clamp(size.y, 1u, device.max_workgroup_size[1]);
+        while (size.x * size.y > device.max_workgroup_invocations && size.y > 1) {
+            size.y /= 2;
+        }
+        while (size.x * size.y > device.max_workgroup_invocations && size.x > 1) {
+            size.x /= 2;
+        }
+
+        return size;
+    }
+
+    void SpecializationConstants::set(uint32_t constant_id, uint32_t value)
+    {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].constantID == constant_id) {
+                values[i] = value;
+                return;
+            }
+        }
+
+        VkSpecializationMapEntry entry {};
+        entry.constantID = constant_id;
+        entry.offset = (uint32_t)(values.size() * sizeof(uint32_t));
+        entry.size = sizeof(uint32_t);
+
+        entries.push_back(entry);
+        values.push_back(value);
+    }
+
+    VkSpecializationInfo SpecializationConstants::info() const
+    {
+        VkSpecializationInfo info {};
+        info.mapEntryCount = (uint32_t)entries.size();
+        info.pMapEntries = entries.data();
+        info.dataSize = values.size() * sizeof(uint32_t);
+        info.pData = values.data();
+
+        return info;
+    }
+
+    void ComputePipelineBuilder::add_set_layout(VkDescriptorSetLayout layout)
+    {
+        set_layouts.push_back(layout);
+    }
+
+    void ComputePipelineBuilder::add_push_constant_range(uint32_t size, uint32_t offset)
+    {
+        VkPushConstantRange range {};
+        range.offset = offset;
+        range.size = size;
+        range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        push_constant_ranges.push_back(range);
+    }
+
+    void ComputePipelineBuilder::clear()
+    {
+        set_layouts.clear();
+        push_constant_ranges.clear();
+    }
+
+    VkPipelineLayout ComputePipelineBuilder::build_layout(VkDevice device)
+    {
+        // The pipeline layout describes everything the shader can access besides vertex inputs:
+        // the descriptor sets and the push constants.
+        VkPipelineLayoutCreateInfo layout_info {};
+        layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layout_info.setLayoutCount = (uint32_t)set_layouts.size();
+        layout_info.pSetLayouts = set_layouts.data();
+        layout_info.pushConstantRangeCount = (uint32_t)push_constant_ranges.size();
+        layout_info.pPushConstantRanges = push_constant_ranges.data();
+
+        VkPipelineLayout layout;
+        if (vkCreatePipelineLayout(device, &layout_info, nullptr, &layout) != VK_SUCCESS) {
+            std::cout << "Failed to create pipeline layout" << std::endl;
+            std::terminate();
+        }
+
+        return layout;
+    }
+
+    VkPipelineLayout ComputePipelineBuilder::build_layout(PipelineLayoutCache& layout_cache)
+    {
+        return layout_cache.get(set_layouts, push_constant_ranges);
+    }
+
+    VkPipeline ComputePipelineBuilder::build_pipeline(VkDevice device, VkPipelineLayout layout, VkShaderModule shader_module, VkPipelineCache pipeline_cache)
+    {
+        VkPipeline pipeline;
+        if (!create_compute_pipeline(device, layout, shader_module, pipeline_cache, &pipeline)) {
+            std::terminate();
+        }
+
+        return pipeline;
+    }
+
+    bool create_compute_pipeline(VkDevice device, VkPipelineLayout layout, VkShaderModule shader_module, VkPipelineCache pipeline_cache, VkPipeline* out_pipeline,
+        const VkSpecializationInfo* specialization, VkPipelineCreateFlags flags)
+    {
+        // A compute pipeline only has a single stage, so it's a lot simpler than a graphics pipeline.
+        VkPipelineShaderStageCreateInfo stage_info {};
+        stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        stage_info.module = shader_module;
+        stage_info.pName = "main";
+        stage_info.pSpecializationInfo = specialization;
+
+        VkComputePipelineCreateInfo pipeline_info {};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_info.flags = flags;
+        pipeline_info.layout = layout;
+        pipeline_info.stage = stage_info;
+
+        if (vkCreateComputePipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, out_pipeline) != VK_SUCCESS) {
+            std::cout << "Failed to create compute pipeline" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ComputeEffect::build_pipeline(VkDevice device, VkPipelineCache pipeline_cache, VkPipeline* out_pipeline) const
+    {
+        std::string path = std::string(CIORAN_SHADER_DIR) + "/" + shader_file;
+
+        VkShaderModule shader_module;
+        if (!load_shader_module(device, path.c_str(), &shader_module)) {
+            return false;
+        }
+
+        VkSpecializationInfo specialization_info = specialization.info();
+        bool created = create_compute_pipeline(device, layout, shader_module, pipeline_cache, out_pipeline, &specialization_info, pipeline_flags);
+
+        // The pipeline keeps what it needs from the shader module, so the module can go right away
+        vkDestroyShaderModule(device, shader_module, nullptr);
+
+        return created;
+    }
+
+    void ComputeEffect::set_workgroup_size(WorkgroupSize size)
+    {
+        workgroup_size_x = size.x;
+        workgroup_size_y = size.y;
+        specialization.set(WORKGROUP_SIZE_X_CONSTANT_ID, size.x);
+        specialization.set(WORKGROUP_SIZE_Y_CONSTANT_ID, size.y);
+    }
+
+    void ComputeEffect::dispatch(VkCommandBuffer cmd, VkExtent2D extent) const
+    {
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &data);
+
+        // Round up, so the edges are covered when the extent isn't a multiple of the workgroup size.
+        // The shader skips the invocations that fall outside of the image.
+        uint32_t group_count_x = (extent.width + workgroup_size_x - 1) / workgroup_size_x;
+        uint32_t group_count_y = (extent.height + workgroup_size_y - 1) / workgroup_size_y;
+        vkCmdDispatch(cmd, group_count_x, group_count_y, 1);
+    }
+
+    void ComputeEffect::destroy(VkDevice device)
+    {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    }
+}
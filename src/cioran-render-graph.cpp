@@ -0,0 +1,579 @@
+#include "cioran-render-graph.h"
+
+#include <algorithm>
+
+namespace cioran {
+    bool TransientImageInfo::operator==(const TransientImageInfo& other) const
+    {
+        return format == other.format &&
+            extent.width == other.extent.width &&
+            extent.height == other.extent.height &&
+            extent.depth == other.extent.depth &&
+            usage == other.usage;
+    }
+
+    void RenderGraphPass::read(GraphImage image, ImageUsage usage)
+    {
+        image_accesses.push_back({ image, usage, false, false });
+    }
+
+    void RenderGraphPass::write(GraphImage image, ImageUsage usage, bool discard)
+    {
+        image_accesses.push_back({ image, usage, true, discard });
+    }
+
+    void RenderGraphPass::read(GraphBuffer buffer, BufferUsage usage)
+    {
+        buffer_accesses.push_back({ buffer, usage, false, false });
+    }
+
+    void RenderGraphPass::write(GraphBuffer buffer, BufferUsage usage, bool discard)
+    {
+        buffer_accesses.push_back({ buffer, usage, true, discard });
+    }
+
+    static bool is_depth_format(VkFormat format)
+    {
+        switch (format) {
+            case VK_FORMAT_D16_UNORM:
+            case VK_FORMAT_X8_D24_UNORM_PACK32:
+            case VK_FORMAT_D32_SFLOAT:
+            case VK_FORMAT_D16_UNORM_S8_UINT:
+            case VK_FORMAT_D24_UNORM_S8_UINT:
+            case VK_FORMAT_D32_SFLOAT_S8_UINT:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static bool lifetimes_overlap(const RenderGraph::TransientImage& a, const RenderGraph::TransientImage& b)
+    {
+        return a.first_pass <= b.last_pass && b.first_pass <= a.last_pass;
+    }
+
+    void RenderGraph::init(VkDevice device, VmaAllocator allocator, uint32_t graphics_queue_family, uint32_t compute_queue_family)
+    {
+        this->device = device;
+        this->allocator = allocator;
+        this->graphics_queue_family = graphics_queue_family;
+        this->compute_queue_family = compute_queue_family;
+    }
+
+    void RenderGraph::destroy()
+    {
+        reset();
+
+        for (const TransientImage& transient : transient_images) {
+            if (transient.image_view != VK_NULL_HANDLE) {
+                vkDestroyImageView(device, transient.image_view, nullptr);
+            }
+            if (transient.image != VK_NULL_HANDLE) {
+                vkDestroyImage(device, transient.image, nullptr);
+            }
+        }
+        for (const AliasSlot& slot : alias_slots) {
+            vmaFreeMemory(allocator, slot.allocation);
+        }
+
+        transient_images.clear();
+        alias_slots.clear();
+    }
+
+    void RenderGraph::reset()
+    {
+        passes.clear();
+        images.clear();
+        buffers.clear();
+        transient_infos.clear();
+        final_barriers.image_barriers.clear();
+        final_barriers.buffer_barriers.clear();
+        release_barriers.image_barriers.clear();
+        release_barriers.buffer_barriers.clear();
+        graphics_wait_stage = VK_PIPELINE_STAGE_2_NONE;
+        compute_wait_stage = VK_PIPELINE_STAGE_2_NONE;
+    }
+
+    GraphImage RenderGraph::import_image(VkImage image, VkImageView image_view, ImageState& state)
+    {
+        images.push_back({ image, image_view, &state, UINT32_MAX, false, false, ImageUsage::present });
+        return { (uint32_t)images.size() - 1 };
+    }
+
+    GraphBuffer RenderGraph::import_buffer(VkBuffer buffer, BufferState& state)
+    {
+        buffers.push_back({ buffer, &state, false });
+        return { (uint32_t)buffers.size() - 1 };
+    }
+
+    GraphImage RenderGraph::create_image(const TransientImageInfo& info)
+    {
+        transient_infos.push_back(info);
+
+        // The image itself doesn't exist until the graph is compiled.
+        images.push_back({ VK_NULL_HANDLE, VK_NULL_HANDLE, nullptr, (uint32_t)transient_infos.size() - 1, false, false, ImageUsage::present });
+        return { (uint32_t)images.size() - 1 };
+    }
+
+    void RenderGraph::mark_output(GraphImage image)
+    {
+        images[image.index].output = true;
+    }
+
+    void RenderGraph::mark_output(GraphImage image, ImageUsage final_usage)
+    {
+        images[image.index].output = true;
+        images[image.index].has_final_usage = true;
+        images[image.index].final_usage = final_usage;
+    }
+
+    void RenderGraph::mark_output(GraphBuffer buffer)
+    {
+        buffers[buffer.index].output = true;
+    }
+
+    RenderGraphPass& RenderGraph::add_pass(const char* name)
+    {
+        RenderGraphPass& pass = passes.emplace_back();
+        pass.name = name;
+        pass.queue = PassQueue::graphics;
+        pass.live = false;
+        pass.on_compute_queue = false;
+        return pass;
+    }
+
+    void RenderGraph::compile(DeferredDestroyer& destroyer)
+    {
+        cull_passes();
+        allocate_transient_images(destroyer);
+        resolve_barriers();
+    }
+
+    void RenderGraph::cull_passes()
+    {
+        // Walk the passes backwards, and keep track of which resources a later live pass still needs the contents of.
+        // A pass is live if it writes to a resource that is needed. The resources it reads are then needed as well.
+        std::vector<bool> image_needed(images.size());
+        std::vector<bool> buffer_needed(buffers.size());
+
+        for (size_t i = 0; i < images.size(); i++) {
+            image_needed[i] = images[i].output;
+        }
+        for (size_t i = 0; i < buffers.size(); i++) {
+            buffer_needed[i] = buffers[i].output;
+        }
+
+        for (size_t i = passes.size(); i-- > 0;) {
+            RenderGraphPass& pass = passes[i];
+            pass.live = false;
+
+            for (const ImageAccess& access : pass.image_accesses) {
+                pass.live |= access.writes && image_needed[access.image.index];
+            }
+            for (const BufferAccess& access : pass.buffer_accesses) {
+                pass.live |= access.writes && buffer_needed[access.buffer.index];
+            }
+
+            if (!pass.live) {
+                continue;
+            }
+
+            // A write that discards the contents means earlier writes to the resource are lost anyway,
+            // so the passes doing them are not needed for this resource anymore.
+            // Every other access depends on the current contents.
+            for (const ImageAccess& access : pass.image_accesses) {
+                image_needed[access.image.index] = !(access.writes && access.discard);
+            }
+            for (const BufferAccess& access : pass.buffer_accesses) {
+                buffer_needed[access.buffer.index] = !(access.writes && access.discard);
+            }
+        }
+    }
+
+    void RenderGraph::allocate_transient_images(DeferredDestroyer& destroyer)
+    {
+        // The lifetime of each transient image is the range of live passes using it.
+        std::vector<TransientImage> planned(transient_infos.size());
+        for (size_t i = 0; i < transient_infos.size(); i++) {
+            planned[i].info = transient_infos[i];
+            planned[i].first_pass = UINT32_MAX;
+            planned[i].last_pass = 0;
+        }
+
+        for (uint32_t pass_index = 0; pass_index < passes.size(); pass_index++) {
+            if (!passes[pass_index].live) {
+                continue;
+            }
+
+            for (const ImageAccess& access : passes[pass_index].image_accesses) {
+                uint32_t transient_index = images[access.image.index].transient_index;
+                if (transient_index == UINT32_MAX) {
+                    continue;
+                }
+
+                planned[transient_index].first_pass = std::min(planned[transient_index].first_pass, pass_index);
+                planned[transient_index].last_pass = std::max(planned[transient_index].last_pass, pass_index);
+            }
+        }
+
+        // Most frames declare the same transient images as the frame before, so the allocated images can be reused as they are.
+        bool same_plan = planned.size() == transient_images.size();
+        for (size_t i = 0; same_plan && i < planned.size(); i++) {
+            same_plan = planned[i].info == transient_images[i].info &&
+                planned[i].first_pass == transient_images[i].first_pass &&
+                planned[i].last_pass == transient_images[i].last_pass;
+        }
+
+        if (same_plan) {
+            return;
+        }
+
+        // Retire the current images. Frames in flight can still be using them.
+        for (const TransientImage& transient : transient_images) {
+            if (transient.image_view != VK_NULL_HANDLE) {
+                destroyer.retire_image_view(transient.image_view);
+            }
+            if (transient.image != VK_NULL_HANDLE) {
+                destroyer.retire_image(transient.image);
+            }
+        }
+        for (const AliasSlot& slot : alias_slots) {
+            destroyer.retire_allocation(slot.allocation);
+        }
+
+        transient_images = std::move(planned);
+        alias_slots.clear();
+
+        // Images not used by any live pass don't need to exist.
+        std::vector<VkMemoryRequirements> requirements(transient_images.size());
+        std::vector<uint32_t> order;
+
+        for (uint32_t i = 0; i < transient_images.size(); i++) {
+            TransientImage& transient = transient_images[i];
+            transient.image = VK_NULL_HANDLE;
+            transient.image_view = VK_NULL_HANDLE;
+            transient.state = {};
+            transient.slot = UINT32_MAX;
+
+            if (transient.first_pass == UINT32_MAX) {
+                continue;
+            }
+
+            VkImageCreateInfo image_info = create_image_create_info(transient.info.format, transient.info.usage, transient.info.extent);
+            if (vkCreateImage(device, &image_info, nullptr, &transient.image) != VK_SUCCESS) {
+                std::cout << "Failed to create transient image" << std::endl;
+                std::terminate();
+            }
+
+            vkGetImageMemoryRequirements(device, transient.image, &requirements[i]);
+            order.push_back(i);
+        }
+
+        // Place the largest images first. Smaller images can then fit into the memory of a larger one
+        // whose lifetime they don't overlap, instead of every slot growing to fit the largest image.
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return requirements[a].size > requirements[b].size;
+        });
+
+        for (uint32_t i : order) {
+            TransientImage& transient = transient_images[i];
+
+            for (uint32_t slot_index = 0; slot_index < alias_slots.size() && transient.slot == UINT32_MAX; slot_index++) {
+                AliasSlot& slot = alias_slots[slot_index];
+
+                if ((slot.requirements.memoryTypeBits & requirements[i].memoryTypeBits) == 0) {
+                    continue;
+                }
+
+                bool overlaps = false;
+                for (const TransientImage& other : transient_images) {
+                    overlaps |= other.slot == slot_index && lifetimes_overlap(transient, other);
+                }
+
+                if (!overlaps) {
+                    slot.requirements.size = std::max(slot.requirements.size, requirements[i].size);
+                    slot.requirements.alignment = std::max(slot.requirements.alignment, requirements[i].alignment);
+                    slot.requirements.memoryTypeBits &= requirements[i].memoryTypeBits;
+                    transient.slot = slot_index;
+                }
+            }
+
+            if (transient.slot == UINT32_MAX) {
+                alias_slots.push_back({ requirements[i], VK_NULL_HANDLE, {} });
+                transient.slot = (uint32_t)alias_slots.size() - 1;
+            }
+        }
+
+        for (AliasSlot& slot : alias_slots) {
+            VmaAllocationCreateInfo allocation_info {};
+            allocation_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+            if (vmaAllocateMemory(allocator, &slot.requirements, &allocation_info, &slot.allocation, nullptr) != VK_SUCCESS) {
+                std::cout << "Failed to allocate memory for transient images" << std::endl;
+                std::terminate();
+            }
+        }
+
+        // Views can only be created for images with a usage that reads or writes through a view.
+        constexpr VkImageUsageFlags VIEW_USAGE_MASK {
+            VK_IMAGE_USAGE_SAMPLED_BIT |
+            VK_IMAGE_USAGE_STORAGE_BIT |
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+            VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT
+        };
+
+        for (TransientImage& transient : transient_images) {
+            if (transient.image == VK_NULL_HANDLE) {
+                continue;
+            }
+
+            if (vmaBindImageMemory(allocator, alias_slots[transient.slot].allocation, transient.image) != VK_SUCCESS) {
+                std::cout << "Failed to bind transient image memory" << std::endl;
+                std::terminate();
+            }
+
+            if ((transient.info.usage & VIEW_USAGE_MASK) != 0) {
+                VkImageAspectFlags aspect = is_depth_format(transient.info.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+                VkImageViewCreateInfo view_info = create_image_view_create_info(transient.info.format, transient.image, aspect);
+
+                if (vkCreateImageView(device, &view_info, nullptr, &transient.image_view) != VK_SUCCESS) {
+                    std::cout << "Failed to create transient image view" << std::endl;
+                    std::terminate();
+                }
+            }
+        }
+    }
+
+    void RenderGraph::resolve_barriers()
+    {
+        for (ImageResource& resource : images) {
+            if (resource.transient_index != UINT32_MAX) {
+                TransientImage& transient = transient_images[resource.transient_index];
+                resource.image = transient.image;
+                resource.image_view = transient.image_view;
+                resource.state = &transient.state;
+            }
+        }
+
+        // The passes of each queue run in declaration order, so walking them in that order sees the same states the GPU will.
+        std::vector<bool> image_used_on_graphics(images.size());
+        std::vector<bool> buffer_used_on_graphics(buffers.size());
+
+        for (uint32_t pass_index = 0; pass_index < passes.size(); pass_index++) {
+            RenderGraphPass& pass = passes[pass_index];
+            if (!pass.live) {
+                continue;
+            }
+
+            pass.on_compute_queue = pass.queue == PassQueue::async_compute &&
+                compute_queue_family != graphics_queue_family &&
+                can_run_async(pass_index, image_used_on_graphics, buffer_used_on_graphics);
+
+            uint32_t queue_family = pass.on_compute_queue ? compute_queue_family : graphics_queue_family;
+            VkPipelineStageFlags2& wait_stage = pass.on_compute_queue ? compute_wait_stage : graphics_wait_stage;
+
+            for (const ImageAccess& access : pass.image_accesses) {
+                ImageResource& resource = images[access.image.index];
+                bool discard = access.discard;
+
+                // The memory of a transient image was last used by whichever image was in the slot before,
+                // so the first use has to wait for that image instead. Its contents are garbage either way.
+                if (resource.transient_index != UINT32_MAX) {
+                    TransientImage& transient = transient_images[resource.transient_index];
+                    if (transient.first_pass == pass_index) {
+                        const ImageState& last_state = alias_slots[transient.slot].last_state;
+                        transient.state = { VK_IMAGE_LAYOUT_UNDEFINED, last_state.stage, last_state.access, last_state.queue_family };
+                        discard = true;
+                    }
+                }
+
+                ImageState& state = *resource.state;
+                VkPipelineStageFlags2 next_stage = image_state_for(access.usage).stage;
+
+                if (state.queue_family == VK_QUEUE_FAMILY_IGNORED || state.queue_family == queue_family) {
+                    pass.barriers.transition(resource.image, state, access.usage, discard);
+                } else if (discard) {
+                    // Without contents to keep, there is no need to transfer ownership.
+                    // The other queue is waited for with a semaphore at the stages of this use, which the transition has to chain with.
+                    state.stage = next_stage;
+                    state.access = VK_ACCESS_2_NONE;
+                    wait_stage |= next_stage;
+                    pass.barriers.transition(resource.image, state, access.usage, true);
+                } else {
+                    // Async compute passes never need the contents of a graphics resource, so this is always compute to graphics.
+                    release_barriers.release(resource.image, state, access.usage, queue_family);
+                    pass.barriers.acquire(resource.image, state, access.usage, queue_family);
+                    wait_stage |= next_stage;
+                }
+
+                state.queue_family = queue_family;
+                if (!pass.on_compute_queue) {
+                    image_used_on_graphics[access.image.index] = true;
+                }
+            }
+
+            for (const BufferAccess& access : pass.buffer_accesses) {
+                BufferResource& resource = buffers[access.buffer.index];
+                BufferState& state = *resource.state;
+                VkPipelineStageFlags2 next_stage = buffer_state_for(access.usage).stage;
+
+                if (state.queue_family == VK_QUEUE_FAMILY_IGNORED || state.queue_family == queue_family) {
+                    pass.barriers.transition(resource.buffer, state, access.usage);
+                } else if (access.discard) {
+                    state.stage = next_stage;
+                    state.access = VK_ACCESS_2_NONE;
+                    wait_stage |= next_stage;
+                    pass.barriers.transition(resource.buffer, state, access.usage);
+                } else {
+                    release_barriers.release(resource.buffer, state, access.usage, queue_family);
+                    pass.barriers.acquire(resource.buffer, state, access.usage, queue_family);
+                    wait_stage |= next_stage;
+                }
+
+                state.queue_family = queue_family;
+                if (!pass.on_compute_queue) {
+                    buffer_used_on_graphics[access.buffer.index] = true;
+                }
+            }
+
+            for (const ImageAccess& access : pass.image_accesses) {
+                ImageResource& resource = images[access.image.index];
+                if (resource.transient_index != UINT32_MAX) {
+                    TransientImage& transient = transient_images[resource.transient_index];
+                    if (transient.last_pass == pass_index) {
+                        alias_slots[transient.slot].last_state = transient.state;
+                    }
+                }
+            }
+        }
+
+        // The final transitions are recorded on the graphics queue.
+        for (ImageResource& resource : images) {
+            if (!resource.has_final_usage) {
+                continue;
+            }
+
+            ImageState& state = *resource.state;
+            if (state.queue_family != VK_QUEUE_FAMILY_IGNORED && state.queue_family != graphics_queue_family) {
+                VkPipelineStageFlags2 next_stage = image_state_for(resource.final_usage).stage;
+
+                release_barriers.release(resource.image, state, resource.final_usage, graphics_queue_family);
+                final_barriers.acquire(resource.image, state, resource.final_usage, graphics_queue_family);
+                graphics_wait_stage |= next_stage == VK_PIPELINE_STAGE_2_NONE ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT : next_stage;
+            } else {
+                final_barriers.transition(resource.image, state, resource.final_usage);
+                state.queue_family = graphics_queue_family;
+            }
+        }
+    }
+
+    bool RenderGraph::can_run_async(uint32_t pass_index, const std::vector<bool>& image_used_on_graphics, const std::vector<bool>& buffer_used_on_graphics) const
+    {
+        // The compute batch is submitted before the graphics batch, so anything a graphics pass did earlier in the frame hasn't happened yet.
+        // Resources whose contents are owned by the graphics queue would need a release on the graphics queue first, which has already been submitted.
+        const RenderGraphPass& pass = passes[pass_index];
+
+        for (const ImageAccess& access : pass.image_accesses) {
+            const ImageResource& resource = images[access.image.index];
+            if (image_used_on_graphics[access.image.index]) {
+                return false;
+            }
+
+            bool first_transient_use = resource.transient_index != UINT32_MAX &&
+                transient_images[resource.transient_index].first_pass == pass_index;
+            bool keeps_contents = !access.discard && !first_transient_use;
+
+            if (keeps_contents && resource.state != nullptr && resource.state->queue_family == graphics_queue_family) {
+                return false;
+            }
+        }
+
+        for (const BufferAccess& access : pass.buffer_accesses) {
+            if (buffer_used_on_graphics[access.buffer.index]) {
+                return false;
+            }
+
+            if (!access.discard && buffers[access.buffer.index].state->queue_family == graphics_queue_family) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool RenderGraph::has_compute_work() const
+    {
+        for (const RenderGraphPass& pass : passes) {
+            if (pass.live && pass.on_compute_queue) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void RenderGraph::execute(PassQueue queue, VkDevice device, VkCommandBuffer primary, FrameCommands& commands, JobSystem& jobs)
+    {
+        bool compute = queue == PassQueue::async_compute;
+
+        std::vector<RenderGraphPass*> live_passes;
+        for (RenderGraphPass& pass : passes) {
+            if (pass.live && pass.on_compute_queue == compute) {
+                live_passes.push_back(&pass);
+            }
+        }
+
+        // The last pass of the graphics queue transitions the outputs into their final use,
+        // and the last pass of the compute queue releases the resources the graphics queue takes over.
+        BarrierBatch& closing_barriers = compute ? release_barriers : final_barriers;
+
+        // Each pass is recorded as its own task. The barriers were resolved when compiling,
+        // so a task only touches its own pass, and the tasks can be recorded in any order.
+        std::vector<RecordTask> tasks;
+        for (size_t i = 0; i < live_passes.size(); i++) {
+            RenderGraphPass* pass = live_passes[i];
+            bool last = i == live_passes.size() - 1;
+
+            tasks.push_back([pass, last, &closing_barriers](VkCommandBuffer cmd) {
+                pass->barriers.flush(cmd);
+
+                if (pass->record) {
+                    pass->record(cmd);
+                }
+
+                if (last) {
+                    closing_barriers.flush(cmd);
+                }
+            });
+        }
+
+        if (tasks.empty() && !closing_barriers.empty()) {
+            tasks.push_back([&closing_barriers](VkCommandBuffer cmd) {
+                closing_barriers.flush(cmd);
+            });
+        }
+
+        if (tasks.empty()) {
+            return;
+        }
+
+        std::vector<VkCommandBuffer> secondaries = commands.record_parallel(device, jobs, tasks);
+        vkCmdExecuteCommands(primary, (uint32_t)secondaries.size(), secondaries.data());
+    }
+
+    VkImage RenderGraph::get_image(GraphImage image) const
+    {
+        return images[image.index].image;
+    }
+
+    VkImageView RenderGraph::get_image_view(GraphImage image) const
+    {
+        return images[image.index].image_view;
+    }
+
+    VkBuffer RenderGraph::get_buffer(GraphBuffer buffer) const
+    {
+        return buffers[buffer.index].buffer;
+    }
+}
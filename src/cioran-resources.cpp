@@ -0,0 +1,141 @@
+#include "cioran-resources.h"
+
+#include <algorithm>
+
+namespace cioran {
+    void ResourceRegistry::init(VkDevice device, VmaAllocator allocator, DeferredDestroyer& destroyer, BindlessHeap* bindless, uint32_t image_slots, uint32_t buffer_slots, uint32_t image_view_slots)
+    {
+        this->device = device;
+        this->allocator = allocator;
+        this->destroyer = &destroyer;
+        this->bindless = bindless;
+
+        if (bindless != nullptr) {
+            image_slots = std::min(image_slots, bindless->image_capacity);
+            buffer_slots = std::min(buffer_slots, bindless->buffer_capacity);
+        }
+
+        images.init(image_slots);
+        buffers.init(buffer_slots);
+        image_views.init(image_view_slots);
+    }
+
+    void ResourceRegistry::destroy()
+    {
+        // Views first, since they reference the images.
+        image_views.for_each_alive([&](ImageViewResource& resource) {
+            vkDestroyImageView(device, resource.view, nullptr);
+        });
+        images.for_each_alive([&](AllocatedImage& image) {
+            vkDestroyImageView(device, image.image_view, nullptr);
+            vmaDestroyImage(allocator, image.image, image.allocation);
+        });
+        buffers.for_each_alive([&](AllocatedBuffer& buffer) {
+            cioran::destroy_buffer(allocator, buffer);
+        });
+
+        image_views.destroy();
+        images.destroy();
+        buffers.destroy();
+    }
+
+    ImageHandle ResourceRegistry::create_image(VkFormat format, VkExtent3D extent, VkImageUsageFlags usage, VkImageAspectFlags aspect)
+    {
+        AllocatedImage image {};
+        image.image_format = format;
+        image.image_extent = extent;
+
+        VkImageCreateInfo image_info = create_image_create_info(format, usage, extent);
+
+        // Images are only ever accessed by the GPU, so they are allocated from device local memory.
+        VmaAllocationCreateInfo allocation_info {};
+        allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        allocation_info.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if (vmaCreateImage(allocator, &image_info, &allocation_info, &image.image, &image.allocation, nullptr) != VK_SUCCESS) {
+            std::cout << "Failed to create image" << std::endl;
+            std::terminate();
+        }
+
+        VkImageViewCreateInfo view_info = create_image_view_create_info(format, image.image, aspect);
+        if (vkCreateImageView(device, &view_info, nullptr, &image.image_view) != VK_SUCCESS) {
+            std::cout << "Failed to create image view" << std::endl;
+            std::terminate();
+        }
+
+        ImageHandle handle = images.allocate(image);
+
+        if (bindless != nullptr) {
+            if (usage & VK_IMAGE_USAGE_STORAGE_BIT) {
+                bindless->write_storage_image(handle.index(), image.image_view);
+            }
+            if (usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+                bindless->write_sampled_image(handle.index(), image.image_view);
+            }
+        }
+
+        return handle;
+    }
+
+    BufferHandle ResourceRegistry::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memory_usage, VmaAllocationCreateFlags allocation_flags)
+    {
+        // A heap in a descriptor buffer references storage buffers by their device address.
+        if (bindless != nullptr && bindless->in_descriptor_buffer && (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+            usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+        }
+
+        AllocatedBuffer buffer = cioran::create_buffer(allocator, size, usage, memory_usage, allocation_flags);
+        BufferHandle handle = buffers.allocate(buffer);
+
+        if (bindless != nullptr && (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+            bindless->write_storage_buffer(handle.index(), buffer.buffer, 0, size);
+        }
+
+        return handle;
+    }
+
+    ImageViewHandle ResourceRegistry::create_image_view(ImageHandle image, VkImageViewCreateInfo view_info)
+    {
+        view_info.image = images.get(image).image;
+
+        ImageViewResource resource {};
+        resource.image = image;
+        if (vkCreateImageView(device, &view_info, nullptr, &resource.view) != VK_SUCCESS) {
+            std::cout << "Failed to create image view" << std::endl;
+            std::terminate();
+        }
+
+        return image_views.allocate(resource);
+    }
+
+    void ResourceRegistry::destroy_image(ImageHandle image)
+    {
+        const AllocatedImage& resource = images.get(image);
+        destroyer->retire_image_view(resource.image_view);
+        destroyer->retire_image(resource.image, resource.allocation);
+
+        images.release(image, destroyer->current_epoch.load());
+    }
+
+    void ResourceRegistry::destroy_buffer(BufferHandle buffer)
+    {
+        const AllocatedBuffer& resource = buffers.get(buffer);
+        destroyer->retire_buffer(resource.buffer, resource.allocation);
+
+        buffers.release(buffer, destroyer->current_epoch.load());
+    }
+
+    void ResourceRegistry::destroy_image_view(ImageViewHandle image_view)
+    {
+        destroyer->retire_image_view(image_views.get(image_view).view);
+
+        image_views.release(image_view, destroyer->current_epoch.load());
+    }
+
+    void ResourceRegistry::reclaim(uint64_t completed_epoch)
+    {
+        images.reclaim(completed_epoch);
+        buffers.reclaim(completed_epoch);
+        image_views.reclaim(completed_epoch);
+    }
+}
@@ -0,0 +1,215 @@
+#include "cioran-settings.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+namespace cioran {
+    // Parses the value of a numeric flag. Anything that isn't a whole number in the range stops the program,
+    // so a typo can't silently fall back to a default.
+    static long parse_integer(const char* flag, const char* value, long min, long max)
+    {
+        char* end = nullptr;
+        errno = 0;
+        long number = std::strtol(value, &end, 10);
+        if (end == value || *end != '\0' || errno == ERANGE) {
+            std::cout << "Failed to parse " << flag << " '" << value << "', expected a number" << std::endl;
+            std::terminate();
+        }
+        if (number < min || number > max) {
+            std::cout << "Invalid " << flag << " '" << value << "', expected a number from " << min << " to " << max << std::endl;
+            std::terminate();
+        }
+
+        return number;
+    }
+
+    // Stops the program on a value that a flag with a fixed set of values doesn't know.
+    [[noreturn]] static void unknown_value(const char* flag, const char* value)
+    {
+        std::cout << "Unknown value '" << value << "' for " << flag << std::endl;
+        std::terminate();
+    }
+
+    // Parses the value of an on/off flag.
+    static bool parse_switch(const char* flag, const char* value)
+    {
+        if (std::strcmp(value, "on") == 0) {
+            return true;
+        } else if (std::strcmp(value, "off") == 0) {
+            return false;
+        }
+        unknown_value(flag, value);
+    }
+
+    RenderSettings parse_render_settings(int argc, char** argv)
+    {
+        RenderSettings settings {};
+        uint32_t requested_frames = 0;
+        bool present_mode_given = false;
+        int pacing = -1;
+
+        for (int i = 1; i < argc; i++) {
+            const char* arg = argv[i];
+            const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if (std::strcmp(arg, "--latency") == 0 && value != nullptr) {
+                if (std::strcmp(value, "low") == 0) {
+                    settings.latency_mode = LatencyMode::low_latency;
+                } else if (std::strcmp(value, "balanced") == 0) {
+                    settings.latency_mode = LatencyMode::balanced;
+                } else if (std::strcmp(value, "throughput") == 0) {
+                    settings.latency_mode = LatencyMode::max_throughput;
+                } else {
+                    unknown_value(arg, value);
+                }
+                i++;
+            } else if (std::strcmp(arg, "--frames") == 0 && value != nullptr) {
+                requested_frames = (uint32_t)parse_integer(arg, value, MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
+                i++;
+            } else if (std::strcmp(arg, "--present") == 0 && value != nullptr) {
+                present_mode_given = true;
+                if (std::strcmp(value, "fifo") == 0) {
+                    settings.present_mode = VK_PRESENT_MODE_FIFO_KHR;
+                } else if (std::strcmp(value, "fifo_relaxed") == 0) {
+                    settings.present_mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+                } else if (std::strcmp(value, "mailbox") == 0) {
+                    settings.present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+                } else if (std::strcmp(value, "immediate") == 0) {
+                    settings.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+                } else {
+                    unknown_value(arg, value);
+                }
+                i++;
+            } else if (std::strcmp(arg, "--swapchain-images") == 0 && value != nullptr) {
+                settings.swapchain_image_count = (uint32_t)parse_integer(arg, value, 0, MAX_SWAPCHAIN_IMAGES);
+                i++;
+            } else if (std::strcmp(arg, "--benchmark") == 0) {
+                settings.benchmark = true;
+            } else if (std::strcmp(arg, "--pacing") == 0 && value != nullptr) {
+                if (std::strcmp(value, "jit") == 0) {
+                    pacing = 1;
+                } else if (std::strcmp(value, "off") == 0) {
+                    pacing = 0;
+                } else {
+                    unknown_value(arg, value);
+                }
+                i++;
+            } else if (std::strcmp(arg, "--fps-limit") == 0 && value != nullptr) {
+                settings.fps_limit = (uint32_t)parse_integer(arg, value, 0, MAX_FPS_LIMIT);
+                i++;
+            } else if (std::strcmp(arg, "--worker-threads") == 0 && value != nullptr) {
+                settings.worker_threads = (uint32_t)parse_integer(arg, value, 0, MAX_WORKER_THREADS);
+                i++;
+            } else if (std::strcmp(arg, "--render-cpu") == 0 && value != nullptr) {
+                // -1 leaves the render thread unpinned, like not giving the flag.
+                settings.render_thread_cpu = (int)parse_integer(arg, value, -1, MAX_RENDER_CPU);
+                i++;
+            } else if (std::strcmp(arg, "--render-priority") == 0 && value != nullptr) {
+                if (std::strcmp(value, "normal") == 0) {
+                    settings.render_thread_priority = ThreadPriority::normal;
+                } else if (std::strcmp(value, "high") == 0) {
+                    settings.render_thread_priority = ThreadPriority::high;
+                } else if (std::strcmp(value, "critical") == 0) {
+                    settings.render_thread_priority = ThreadPriority::time_critical;
+                } else {
+                    unknown_value(arg, value);
+                }
+                i++;
+            } else if (std::strcmp(arg, "--async-compute") == 0 && value != nullptr) {
+                settings.async_compute = parse_switch(arg, value);
+                i++;
+            } else if (std::strcmp(arg, "--hot-reload") == 0 && value != nullptr) {
+                settings.shader_hot_reload = parse_switch(arg, value);
+                i++;
+            } else if (std::strcmp(arg, "--descriptor-backend") == 0 && value != nullptr) {
+                if (std::strcmp(value, "buffer") == 0) {
+                    settings.descriptor_backend = DescriptorBackend::buffer;
+                } else if (std::strcmp(value, "push") == 0) {
+                    settings.descriptor_backend = DescriptorBackend::push;
+                } else if (std::strcmp(value, "pool") == 0) {
+                    settings.descriptor_backend = DescriptorBackend::pool;
+                } else {
+                    unknown_value(arg, value);
+                }
+                i++;
+            }
+        }
+
+        // Measuring the real cost of a frame requires that we are not capped by vsync.
+        if (settings.benchmark && !present_mode_given) {
+            settings.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+
+        settings.frames_in_flight = default_frames_in_flight(settings.latency_mode);
+
+        // Just in time pacing is what low latency mode is about, so it's on by default there.
+        settings.just_in_time_pacing = pacing == -1
+            ? settings.latency_mode == LatencyMode::low_latency
+            : pacing == 1;
+
+        // An explicit frame count wins over the one implied by the latency mode.
+        if (requested_frames != 0) {
+            settings.frames_in_flight = requested_frames;
+        }
+
+        return settings;
+    }
+
+    uint32_t default_frames_in_flight(LatencyMode mode)
+    {
+        switch (mode) {
+            case LatencyMode::low_latency:
+                return 1;
+            case LatencyMode::max_throughput:
+                return 3;
+            case LatencyMode::balanced:
+            default:
+                return 2;
+        }
+    }
+
+    const char* to_string(LatencyMode mode)
+    {
+        switch (mode) {
+            case LatencyMode::low_latency:
+                return "low latency";
+            case LatencyMode::max_throughput:
+                return "max throughput";
+            case LatencyMode::balanced:
+            default:
+                return "balanced";
+        }
+    }
+
+    const char* to_string(VkPresentModeKHR present_mode)
+    {
+        switch (present_mode) {
+            case VK_PRESENT_MODE_IMMEDIATE_KHR:
+                return "immediate";
+            case VK_PRESENT_MODE_MAILBOX_KHR:
+                return "mailbox";
+            case VK_PRESENT_MODE_FIFO_KHR:
+                return "fifo";
+            case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+                return "fifo relaxed";
+            default:
+                return "unknown";
+        }
+    }
+
+    const char* to_string(DescriptorBackend backend)
+    {
+        switch (backend) {
+            case DescriptorBackend::buffer:
+                return "descriptor buffer";
+            case DescriptorBackend::push:
+                return "push descriptors";
+            case DescriptorBackend::pool:
+            default:
+                return "descriptor pool";
+        }
+    }
+}
@@ -0,0 +1,204 @@
+#include "cioran-shader-reload.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace cioran {
+    void ShaderWatcher::init(const std::string& directory)
+    {
+        this->directory = directory;
+        last_poll_time = std::chrono::steady_clock::now();
+
+#ifdef __linux__
+        // Rewritten files show up as a close after writing. Tools that write to a temporary file first and rename it over the old one
+        // show up as a move into the directory instead.
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd != -1) {
+            watch_descriptor = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (watch_descriptor == -1) {
+                close(inotify_fd);
+                inotify_fd = -1;
+            }
+        }
+#endif
+
+        std::cout << "Shader hot reload: watching " << directory << (inotify_fd != -1 ? " with inotify" : " by polling") << std::endl;
+    }
+
+    void ShaderWatcher::destroy()
+    {
+#ifdef __linux__
+        if (inotify_fd != -1) {
+            close(inotify_fd);
+            inotify_fd = -1;
+            watch_descriptor = -1;
+        }
+#endif
+        files.clear();
+    }
+
+    void ShaderWatcher::watch(const std::string& file_name)
+    {
+        for (const WatchedFile& file : files) {
+            if (file.name == file_name) {
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::file_time_type last_write_time = std::filesystem::last_write_time(std::filesystem::path(directory) / file_name, error);
+        files.push_back({ file_name, error ? std::filesystem::file_time_type::min() : last_write_time });
+    }
+
+    std::vector<std::string> ShaderWatcher::poll()
+    {
+        return inotify_fd != -1 ? poll_inotify() : poll_modification_times();
+    }
+
+    std::vector<std::string> ShaderWatcher::poll_inotify()
+    {
+        std::vector<std::string> changed;
+
+#ifdef __linux__
+        alignas(inotify_event) char buffer[4096];
+
+        while (true) {
+            ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+            // With a non-blocking descriptor, running out of events is an error of EAGAIN.
+            if (length <= 0) {
+                break;
+            }
+
+            for (char* pointer = buffer; pointer < buffer + length;) {
+                const inotify_event* event = (const inotify_event*)pointer;
+                pointer += sizeof(inotify_event) + event->len;
+
+                if (event->len == 0) {
+                    continue;
+                }
+
+                std::string name = event->name;
+                bool watched = std::any_of(files.begin(), files.end(), [&](const WatchedFile& file) { return file.name == name; });
+                if (watched && std::find(changed.begin(), changed.end(), name) == changed.end()) {
+                    changed.push_back(name);
+                }
+            }
+        }
+#endif
+
+        return changed;
+    }
+
+    std::vector<std::string> ShaderWatcher::poll_modification_times()
+    {
+        std::vector<std::string> changed;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_poll_time < SHADER_POLL_INTERVAL) {
+            return changed;
+        }
+        last_poll_time = now;
+
+        for (WatchedFile& file : files) {
+            std::error_code error;
+            std::filesystem::file_time_type last_write_time = std::filesystem::last_write_time(std::filesystem::path(directory) / file.name, error);
+            // The file can briefly be missing while it's being replaced. It's picked up on a later poll.
+            if (error || last_write_time == file.last_write_time) {
+                continue;
+            }
+
+            file.last_write_time = last_write_time;
+            changed.push_back(file.name);
+        }
+
+        return changed;
+    }
+
+    void ShaderHotReload::init(VkDevice device, VkPipelineCache pipeline_cache, const std::string& shader_directory)
+    {
+        this->device = device;
+        this->pipeline_cache = pipeline_cache;
+        watcher.init(shader_directory);
+    }
+
+    void ShaderHotReload::destroy()
+    {
+        for (const std::unique_ptr<Rebuild>& rebuild : rebuilds) {
+            BackgroundQueue::wait(rebuild->job);
+            if (rebuild->pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, rebuild->pipeline, nullptr);
+            }
+        }
+
+        rebuilds.clear();
+        effects.clear();
+        watcher.destroy();
+    }
+
+    void ShaderHotReload::add_effect(ComputeEffect& effect)
+    {
+        effects.push_back(&effect);
+        watcher.watch(effect.shader_file);
+    }
+
+    void ShaderHotReload::update(BackgroundQueue& background, DeferredDestroyer& destroyer)
+    {
+        // Start a rebuild for every effect using a changed shader.
+        for (const std::string& file_name : watcher.poll()) {
+            for (ComputeEffect* effect : effects) {
+                if (file_name != effect->shader_file) {
+                    continue;
+                }
+
+                std::cout << "Shader hot reload: rebuilding " << effect->name << std::endl;
+
+                std::unique_ptr<Rebuild> rebuild = std::make_unique<Rebuild>();
+                rebuild->effect = effect;
+                rebuild->pipeline = VK_NULL_HANDLE;
+
+                // Only the effect's shader file and layout are read while building, and neither changes while running.
+                Rebuild* target = rebuild.get();
+                VkDevice device = this->device;
+                VkPipelineCache pipeline_cache = this->pipeline_cache;
+                rebuild->job = background.schedule([target, device, pipeline_cache]() {
+                    if (!target->effect->build_pipeline(device, pipeline_cache, &target->pipeline)) {
+                        target->pipeline = VK_NULL_HANDLE;
+                    }
+                });
+
+                rebuilds.push_back(std::move(rebuild));
+            }
+        }
+
+        // Swap in the finished rebuilds. Rebuilds of the same effect are swapped in the order they were started,
+        // so an older build that happens to finish last never replaces a newer one.
+        std::vector<ComputeEffect*> waiting_effects;
+        for (auto it = rebuilds.begin(); it != rebuilds.end();) {
+            Rebuild& rebuild = **it;
+
+            bool finished = BackgroundQueue::is_finished(rebuild.job);
+
+            bool waiting = std::find(waiting_effects.begin(), waiting_effects.end(), rebuild.effect) != waiting_effects.end();
+            if (!finished || waiting) {
+                waiting_effects.push_back(rebuild.effect);
+                it++;
+                continue;
+            }
+
+            if (rebuild.pipeline != VK_NULL_HANDLE) {
+                destroyer.retire_pipeline(rebuild.effect->pipeline);
+                rebuild.effect->pipeline = rebuild.pipeline;
+                std::cout << "Shader hot reload: swapped in " << rebuild.effect->name << std::endl;
+            } else {
+                std::cout << "Shader hot reload: failed to rebuild " << rebuild.effect->name << ", keeping the old pipeline" << std::endl;
+            }
+
+            it = rebuilds.erase(it);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#include "cioran-staging.h"
+
+namespace cioran {
+    static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void StagingRing::init(VmaAllocator allocator, VkDeviceSize capacity)
+    {
+        // Sequential writes only, since we memcpy into the ring and never read from it.
+        buffer = create_buffer(allocator, capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO,
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        mapped = (uint8_t*)buffer.info.pMappedData;
+        this->capacity = capacity;
+        head = 0;
+        tail = 0;
+        closed_batches.clear();
+    }
+
+    void StagingRing::destroy(VmaAllocator allocator)
+    {
+        destroy_buffer(allocator, buffer);
+        mapped = nullptr;
+        closed_batches.clear();
+    }
+
+    bool StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset, void*& pointer)
+    {
+        if (size > capacity) {
+            return false;
+        }
+
+        VkDeviceSize position = head % capacity;
+        VkDeviceSize padding = align_up(position, alignment) - position;
+
+        // Allocations are contiguous, so if it doesn't fit before the end, the rest of the ring is skipped.
+        // The start of the buffer satisfies any alignment.
+        if (position + padding + size > capacity) {
+            padding = capacity - position;
+        }
+
+        if (head + padding + size - tail > capacity) {
+            return false;
+        }
+
+        offset = (head + padding) % capacity;
+        pointer = mapped + offset;
+        head += padding + size;
+
+        return true;
+    }
+
+    void StagingRing::close_batch(uint64_t timeline_value)
+    {
+        uint64_t batch_start = closed_batches.empty() ? tail : closed_batches.back().end;
+        if (head == batch_start) {
+            return;
+        }
+
+        closed_batches.push_back({ timeline_value, head });
+    }
+
+    void StagingRing::reclaim(uint64_t completed_value)
+    {
+        while (!closed_batches.empty() && closed_batches.front().timeline_value <= completed_value) {
+            tail = closed_batches.front().end;
+            closed_batches.pop_front();
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#include "cioran-stats.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace cioran {
+    constexpr std::chrono::seconds REPORT_INTERVAL { 1 };
+
+    void FrameStats::init()
+    {
+        last_frame_end = Clock::now();
+        last_report = last_frame_end;
+        cpu_start = last_frame_end;
+        reset_interval();
+    }
+
+    void FrameStats::begin_cpu_work()
+    {
+        cpu_start = Clock::now();
+    }
+
+    void FrameStats::end_frame()
+    {
+        Clock::time_point now = Clock::now();
+
+        double frame_time_ms = std::chrono::duration<double, std::milli>(now - last_frame_end).count();
+        double cpu_time_ms = std::chrono::duration<double, std::milli>(now - cpu_start).count();
+        last_frame_end = now;
+
+        frame_time_sum_ms += frame_time_ms;
+        frame_time_min_ms = std::min(frame_time_min_ms, frame_time_ms);
+        frame_time_max_ms = std::max(frame_time_max_ms, frame_time_ms);
+        cpu_time_sum_ms += cpu_time_ms;
+        frame_count++;
+
+        if (now - last_report < REPORT_INTERVAL) {
+            return;
+        }
+
+        double average_ms = frame_time_sum_ms / frame_count;
+        std::cout << "Frames: " << frame_count
+            << " | avg " << average_ms << " ms (" << 1000.0 / average_ms << " fps)"
+            << " | min " << frame_time_min_ms << " ms"
+            << " | max " << frame_time_max_ms << " ms"
+            << " | cpu " << cpu_time_sum_ms / frame_count << " ms";
+
+        if (latency_count > 0) {
+            std::cout << " | latency " << latency_sum_ms / latency_count << " ms";
+        }
+        std::cout << std::endl;
+
+        last_report = now;
+        reset_interval();
+    }
+
+    void FrameStats::record_latency(double latency_ms)
+    {
+        latency_sum_ms += latency_ms;
+        latency_count++;
+    }
+
+    void FrameStats::reset_interval()
+    {
+        frame_time_sum_ms = 0.0;
+        frame_time_min_ms = 1e9;
+        frame_time_max_ms = 0.0;
+        cpu_time_sum_ms = 0.0;
+        latency_sum_ms = 0.0;
+        frame_count = 0;
+        latency_count = 0;
+    }
+}
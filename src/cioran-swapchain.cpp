@@ -0,0 +1,110 @@
+#include "cioran-swapchain.h"
+
+#include <exception>
+#include <iostream>
+
+namespace cioran {
+    // How long shutdown waits for presents that haven't completed yet.
+    constexpr uint64_t PRESENT_FENCE_TIMEOUT_NS { 1000000000 };
+
+    void SwapchainRetirement::init(VkDevice device, bool present_fences_enabled, bool present_wait_enabled)
+    {
+        this->device = device;
+        present_fences = present_fences_enabled;
+        present_wait = present_wait_enabled;
+        generation = 0;
+    }
+
+    void SwapchainRetirement::destroy()
+    {
+        for (const PendingPresent& present : pending_presents) {
+            vkWaitForFences(device, 1, &present.fence, VK_TRUE, PRESENT_FENCE_TIMEOUT_NS);
+            free_fences.push_back(present.fence);
+        }
+        pending_presents.clear();
+
+        for (VkFence fence : free_fences) {
+            vkDestroyFence(device, fence, nullptr);
+        }
+        free_fences.clear();
+
+        for (const RetiredSwapchain& swapchain : retired) {
+            destroy_swapchain(swapchain);
+        }
+        retired.clear();
+    }
+
+    VkFence SwapchainRetirement::next_present_fence()
+    {
+        VkFence fence = VK_NULL_HANDLE;
+        if (!free_fences.empty()) {
+            fence = free_fences.back();
+            free_fences.pop_back();
+        } else {
+            VkFenceCreateInfo fence_info {};
+            fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+            if (vkCreateFence(device, &fence_info, nullptr, &fence) != VK_SUCCESS) {
+                std::cout << "Failed to create present fence" << std::endl;
+                std::terminate();
+            }
+        }
+
+        pending_presents.push_back({ fence, generation });
+        return fence;
+    }
+
+    void SwapchainRetirement::retire(VkSwapchainKHR swapchain, std::span<const VkImageView> image_views, uint64_t next_present_id)
+    {
+        RetiredSwapchain old_swapchain { swapchain, std::vector<VkImageView>(image_views.begin(), image_views.end()), generation, next_present_id };
+        generation++;
+
+        if (!present_fences && !present_wait) {
+            if (vkDeviceWaitIdle(device) != VK_SUCCESS) {
+                std::cout << "Failed to wait for the device to go idle" << std::endl;
+                std::terminate();
+            }
+            destroy_swapchain(old_swapchain);
+            return;
+        }
+
+        retired.push_back(std::move(old_swapchain));
+    }
+
+    void SwapchainRetirement::collect(uint64_t last_displayed_present_id)
+    {
+        // Presents complete in order, so we stop at the first one that hasn't. The fences are reused for later presents.
+        while (!pending_presents.empty() && vkGetFenceStatus(device, pending_presents.front().fence) == VK_SUCCESS) {
+            VkFence fence = pending_presents.front().fence;
+            pending_presents.pop_front();
+
+            if (vkResetFences(device, 1, &fence) != VK_SUCCESS) {
+                std::cout << "Failed to reset present fence" << std::endl;
+                std::terminate();
+            }
+            free_fences.push_back(fence);
+        }
+
+        for (auto it = retired.begin(); it != retired.end();) {
+            bool done = present_fences
+                ? pending_presents.empty() || pending_presents.front().generation > it->generation
+                : last_displayed_present_id >= it->replacement_present_id;
+
+            if (!done) {
+                it++;
+                continue;
+            }
+
+            destroy_swapchain(*it);
+            it = retired.erase(it);
+        }
+    }
+
+    void SwapchainRetirement::destroy_swapchain(const RetiredSwapchain& swapchain)
+    {
+        for (VkImageView view : swapchain.image_views) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+        vkDestroySwapchainKHR(device, swapchain.swapchain, nullptr);
+    }
+}
@@ -0,0 +1,111 @@
+#include "cioran-sync.h"
+
+#include <iostream>
+
+namespace cioran {
+    void QueueTimeline::init(VkDevice device)
+    {
+        // A semaphore is a timeline semaphore if we chain a VkSemaphoreTypeCreateInfo with the timeline type.
+        // The initial value is 0, so waiting for 0 is always satisfied.
+        VkSemaphoreTypeCreateInfo type_info {};
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_info.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphore_info {};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphore_info.pNext = &type_info;
+
+        if (vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS) {
+            std::cout << "Failed to create timeline semaphore" << std::endl;
+            std::terminate();
+        }
+
+        last_submitted_value = 0;
+        completed_value = 0;
+    }
+
+    void QueueTimeline::destroy(VkDevice device)
+    {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+
+    uint64_t QueueTimeline::next_signal_value()
+    {
+        return ++last_submitted_value;
+    }
+
+    uint64_t QueueTimeline::poll(VkDevice device)
+    {
+        uint64_t value;
+        if (vkGetSemaphoreCounterValue(device, semaphore, &value) != VK_SUCCESS) {
+            std::cout << "Failed to get timeline semaphore value" << std::endl;
+            std::terminate();
+        }
+
+        completed_value = value;
+        return completed_value;
+    }
+
+    bool QueueTimeline::is_complete(VkDevice device, uint64_t value)
+    {
+        return completed_value >= value || poll(device) >= value;
+    }
+
+    bool QueueTimeline::wait(VkDevice device, uint64_t value, uint64_t timeout)
+    {
+        if (completed_value >= value) {
+            return true;
+        }
+
+        VkSemaphoreWaitInfo wait_info {};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &semaphore;
+        wait_info.pValues = &value;
+
+        VkResult result = vkWaitSemaphores(device, &wait_info, timeout);
+        if (result == VK_TIMEOUT) {
+            return false;
+        }
+
+        if (result != VK_SUCCESS) {
+            std::cout << "Failed to wait for timeline semaphore" << std::endl;
+            std::terminate();
+        }
+
+        // Other submissions may have completed as well while we were waiting,
+        // but we only know for sure that the counter has reached the value we waited for.
+        if (value > completed_value) {
+            completed_value = value;
+        }
+
+        return true;
+    }
+
+    VkSemaphoreSubmitInfo QueueTimeline::signal_info(VkPipelineStageFlags2 stage_mask, uint64_t value) const
+    {
+        // For a signal operation, the stage mask defines the stages that have to complete before the semaphore is signaled.
+        VkSemaphoreSubmitInfo submit_info {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        submit_info.semaphore = semaphore;
+        submit_info.value = value;
+        submit_info.stageMask = stage_mask;
+        submit_info.deviceIndex = 0;
+
+        return submit_info;
+    }
+
+    VkSemaphoreSubmitInfo QueueTimeline::wait_info(VkPipelineStageFlags2 stage_mask, uint64_t value) const
+    {
+        // For a wait operation, the stage mask defines the stages that are blocked until the counter reaches the value.
+        VkSemaphoreSubmitInfo submit_info {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        submit_info.semaphore = semaphore;
+        submit_info.value = value;
+        submit_info.stageMask = stage_mask;
+        submit_info.deviceIndex = 0;
+
+        return submit_info;
+    }
+}
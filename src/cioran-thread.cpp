@@ -0,0 +1,56 @@
+#include "cioran-thread.h"
+
+#include "SDL3/SDL.h"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#elif defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+namespace cioran {
+    bool set_current_thread_affinity(uint32_t cpu_index)
+    {
+#if defined(_WIN32)
+        if (cpu_index >= sizeof(DWORD_PTR) * 8) {
+            return false;
+        }
+
+        return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu_index) != 0;
+#elif defined(__linux__)
+        if (cpu_index >= CPU_SETSIZE) {
+            return false;
+        }
+
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu_index, &cpu_set);
+
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+        return false;
+#endif
+    }
+
+    bool set_current_thread_priority(ThreadPriority priority)
+    {
+        // SDL already knows how to do this on every platform it supports
+        SDL_ThreadPriority sdl_priority = SDL_THREAD_PRIORITY_NORMAL;
+        switch (priority) {
+            case ThreadPriority::high:
+                sdl_priority = SDL_THREAD_PRIORITY_HIGH;
+                break;
+            case ThreadPriority::time_critical:
+                sdl_priority = SDL_THREAD_PRIORITY_TIME_CRITICAL;
+                break;
+            case ThreadPriority::normal:
+            default:
+                break;
+        }
+
+        return SDL_SetThreadPriority(sdl_priority) == 0;
+    }
+}
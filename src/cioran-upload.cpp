@@ -0,0 +1,314 @@
+#include "cioran-upload.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cioran {
+    void UploadManager::init(VkDevice device, VmaAllocator allocator, VkQueue queue, uint32_t queue_family, uint32_t graphics_queue_family, VkDeviceSize staging_ring_size)
+    {
+        this->device = device;
+        this->allocator = allocator;
+        this->queue = queue;
+        this->queue_family = queue_family;
+        this->graphics_queue_family = graphics_queue_family;
+
+        timeline.init(device);
+        staging_ring.init(allocator, staging_ring_size);
+        ready_value = 0;
+    }
+
+    void UploadManager::destroy()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        timeline.wait(device, timeline.last_submitted_value, UINT64_MAX);
+
+        for (UploadBatch& batch : batches) {
+            for (const AllocatedBuffer& staging : batch.staging_buffers) {
+                destroy_buffer(allocator, staging);
+            }
+            vkDestroyCommandPool(device, batch.pool, nullptr);
+        }
+        batches.clear();
+
+        for (const AllocatedBuffer& staging : staging_buffers) {
+            destroy_buffer(allocator, staging);
+        }
+        staging_buffers.clear();
+        staging_ring.destroy(allocator);
+
+        buffer_uploads.clear();
+        image_uploads.clear();
+        pending_acquires.clear();
+
+        timeline.destroy(device);
+    }
+
+    uint64_t UploadManager::upload_buffer(const void* data, VkDeviceSize size, VkBuffer destination, VkDeviceSize destination_offset, BufferState& state, BufferUsage final_usage)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        VkDeviceSize staging_offset;
+        VkBuffer staging = stage(data, size, staging_offset);
+
+        VkBufferCopy region {};
+        region.srcOffset = staging_offset;
+        region.dstOffset = destination_offset;
+        region.size = size;
+
+        buffer_uploads.push_back({ staging, staging_offset, destination, &state, region, final_usage });
+
+        // The upload goes out with the next flush, which signals the next timeline value.
+        return timeline.last_submitted_value + 1;
+    }
+
+    uint64_t UploadManager::upload_image(const void* data, VkDeviceSize size, VkImage destination, VkExtent3D extent, ImageState& state, ImageUsage final_usage)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        VkDeviceSize staging_offset;
+        VkBuffer staging = stage(data, size, staging_offset);
+
+        image_uploads.push_back({ staging, staging_offset, destination, &state, extent, final_usage });
+
+        return timeline.last_submitted_value + 1;
+    }
+
+    VkBuffer UploadManager::stage(const void* data, VkDeviceSize size, VkDeviceSize& offset)
+    {
+        void* pointer;
+        bool in_ring = staging_ring.allocate(size, STAGING_ALIGNMENT, offset, pointer);
+
+        // The ring might only be full because we haven't looked at the timeline in a while.
+        if (!in_ring && size <= staging_ring.capacity) {
+            staging_ring.reclaim(timeline.poll(device));
+            in_ring = staging_ring.allocate(size, STAGING_ALIGNMENT, offset, pointer);
+        }
+
+        if (in_ring) {
+            std::memcpy(pointer, data, size);
+
+            // Non coherent memory has to be flushed before the GPU can see the writes. This does nothing for coherent memory.
+            vmaFlushAllocation(allocator, staging_ring.buffer.allocation, offset, size);
+
+            return staging_ring.buffer.buffer;
+        }
+
+        // The upload is bigger than the ring, or the ring is still full of uploads in flight.
+        // Rather than waiting for the GPU, the data goes into a temporary buffer that is destroyed once its batch is done.
+        AllocatedBuffer staging = create_buffer(allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO,
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        std::memcpy(staging.info.pMappedData, data, size);
+        vmaFlushAllocation(allocator, staging.allocation, 0, VK_WHOLE_SIZE);
+
+        staging_buffers.push_back(staging);
+
+        offset = 0;
+        return staging.buffer;
+    }
+
+    UploadManager::UploadBatch& UploadManager::next_batch()
+    {
+        // The batches finish in order, so this is a good time to free space in the ring as well.
+        staging_ring.reclaim(timeline.poll(device));
+
+        // Reuse the first batch the GPU is done with.
+        for (UploadBatch& batch : batches) {
+            if (timeline.is_complete(device, batch.timeline_value)) {
+                for (const AllocatedBuffer& staging : batch.staging_buffers) {
+                    destroy_buffer(allocator, staging);
+                }
+                batch.staging_buffers.clear();
+
+                if (vkResetCommandPool(device, batch.pool, 0) != VK_SUCCESS) {
+                    std::cout << "Failed to reset upload command pool" << std::endl;
+                    std::terminate();
+                }
+
+                return batch;
+            }
+        }
+
+        UploadBatch& batch = batches.emplace_back();
+        batch.pool = create_command_pool(device, queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        batch.cmd = create_command_buffer(device, batch.pool);
+        batch.timeline_value = 0;
+
+        return batch;
+    }
+
+    uint64_t UploadManager::flush()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (buffer_uploads.empty() && image_uploads.empty()) {
+            return 0;
+        }
+
+        UploadBatch& batch = next_batch();
+
+        VkCommandBufferBeginInfo begin_info {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(batch.cmd, &begin_info) != VK_SUCCESS) {
+            std::cout << "Failed to begin upload command buffer" << std::endl;
+            std::terminate();
+        }
+
+        bool transfer_ownership = queue_family != graphics_queue_family;
+        uint64_t signal_value = timeline.next_signal_value();
+
+        // A resource can be the destination of more than one upload in a batch,
+        // but it should only be transitioned, released and acquired once.
+        std::vector<BufferUpload*> unique_buffers;
+        std::vector<ImageUpload*> unique_images;
+        for (BufferUpload& upload : buffer_uploads) {
+            auto same_destination = [&](BufferUpload* other) { return other->destination == upload.destination; };
+            if (std::none_of(unique_buffers.begin(), unique_buffers.end(), same_destination)) {
+                unique_buffers.push_back(&upload);
+            }
+        }
+        for (ImageUpload& upload : image_uploads) {
+            auto same_destination = [&](ImageUpload* other) { return other->destination == upload.destination; };
+            if (std::none_of(unique_images.begin(), unique_images.end(), same_destination)) {
+                unique_images.push_back(&upload);
+            }
+        }
+
+        // Make the destinations writeable for the copies.
+        // They aren't in use on any other queue, so whoever used them before doesn't have to be waited for.
+        BarrierBatch copy_barriers;
+        for (BufferUpload* upload : unique_buffers) {
+            if (upload->state->queue_family != queue_family) {
+                *upload->state = { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, queue_family };
+            }
+            copy_barriers.transition(upload->destination, *upload->state, BufferUsage::transfer_dst);
+        }
+        for (ImageUpload* upload : unique_images) {
+            if (upload->state->queue_family != queue_family) {
+                *upload->state = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, queue_family };
+            }
+            copy_barriers.transition(upload->destination, *upload->state, ImageUsage::transfer_dst, true);
+        }
+        copy_barriers.flush(batch.cmd);
+
+        for (const BufferUpload& upload : buffer_uploads) {
+            vkCmdCopyBuffer(batch.cmd, upload.staging, upload.destination, 1, &upload.region);
+        }
+
+        for (const ImageUpload& upload : image_uploads) {
+            // A row length and image height of 0 means the texels are tightly packed.
+            VkBufferImageCopy region {};
+            region.bufferOffset = upload.staging_offset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = upload.extent;
+
+            vkCmdCopyBufferToImage(batch.cmd, upload.staging, upload.destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        }
+
+        // On a dedicated transfer queue the destinations are released to the graphics queue, which acquires them once the batch is done.
+        // Otherwise they can go straight to their final use, and later submissions on the same queue are ordered after the copies by the barrier.
+        BarrierBatch final_barriers;
+        for (BufferUpload* upload : unique_buffers) {
+            if (transfer_ownership) {
+                final_barriers.release(upload->destination, *upload->state, upload->final_usage, graphics_queue_family);
+                pending_acquires.push_back({ signal_value, upload->destination, upload->state, upload->final_usage, VK_NULL_HANDLE, nullptr, ImageUsage::present });
+            } else {
+                final_barriers.transition(upload->destination, *upload->state, upload->final_usage);
+            }
+        }
+        for (ImageUpload* upload : unique_images) {
+            if (transfer_ownership) {
+                final_barriers.release(upload->destination, *upload->state, upload->final_usage, graphics_queue_family);
+                pending_acquires.push_back({ signal_value, VK_NULL_HANDLE, nullptr, BufferUsage::transfer_dst, upload->destination, upload->state, upload->final_usage });
+            } else {
+                final_barriers.transition(upload->destination, *upload->state, upload->final_usage);
+            }
+        }
+        final_barriers.flush(batch.cmd);
+
+        if (vkEndCommandBuffer(batch.cmd) != VK_SUCCESS) {
+            std::cout << "Failed to end upload command buffer" << std::endl;
+            std::terminate();
+        }
+
+        VkCommandBufferSubmitInfo cmd_info {};
+        cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        cmd_info.commandBuffer = batch.cmd;
+
+        VkSemaphoreSubmitInfo signal_info = timeline.signal_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, signal_value);
+
+        VkSubmitInfo2 submit {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submit.commandBufferInfoCount = 1;
+        submit.pCommandBufferInfos = &cmd_info;
+        submit.signalSemaphoreInfoCount = 1;
+        submit.pSignalSemaphoreInfos = &signal_info;
+
+        if (vkQueueSubmit2(queue, 1, &submit, VK_NULL_HANDLE) != VK_SUCCESS) {
+            std::cout << "Failed to submit uploads" << std::endl;
+            std::terminate();
+        }
+
+        // The staging memory is read by the batch, so it stays in use until the batch is done.
+        staging_ring.close_batch(signal_value);
+        batch.timeline_value = signal_value;
+        batch.staging_buffers = std::move(staging_buffers);
+        staging_buffers.clear();
+
+        buffer_uploads.clear();
+        image_uploads.clear();
+
+        return signal_value;
+    }
+
+    uint64_t UploadManager::acquire_completed_uploads(BarrierBatch& barriers, VkPipelineStageFlags2& wait_stage)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        uint64_t completed_value = timeline.poll(device);
+        uint64_t wait_value = 0;
+
+        // Only finished uploads are acquired, so the semaphore wait that orders the acquire after the release never blocks.
+        auto acquired = std::remove_if(pending_acquires.begin(), pending_acquires.end(), [&](const PendingAcquire& pending) {
+            if (pending.timeline_value > completed_value) {
+                return false;
+            }
+
+            VkPipelineStageFlags2 stage;
+            if (pending.buffer != VK_NULL_HANDLE) {
+                stage = buffer_state_for(pending.buffer_usage).stage;
+                barriers.acquire(pending.buffer, *pending.buffer_state, pending.buffer_usage, graphics_queue_family);
+            } else {
+                stage = image_state_for(pending.image_usage).stage;
+                barriers.acquire(pending.image, *pending.image_state, pending.image_usage, graphics_queue_family);
+            }
+
+            wait_stage |= stage == VK_PIPELINE_STAGE_2_NONE ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT : stage;
+            wait_value = std::max(wait_value, pending.timeline_value);
+            return true;
+        });
+        pending_acquires.erase(acquired, pending_acquires.end());
+
+        ready_value = completed_value;
+        return wait_value;
+    }
+
+    bool UploadManager::is_ready(uint64_t value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (queue_family == graphics_queue_family) {
+            return timeline.is_complete(device, value);
+        }
+
+        return value <= ready_value;
+    }
+}
@@ -1,10 +1,27 @@
 #include "cioran-vulkan.h"
 
+#include <algorithm>
+
 namespace cioran {
+    // VK_EXT_swapchain_maintenance1 on the device needs VK_EXT_surface_maintenance1 on the instance,
+    // which in turn needs VK_KHR_get_surface_capabilities2.
+    static bool surface_maintenance_available()
+    {
+        auto system_info = vkb::SystemInfo::get_system_info();
+        return system_info.has_value()
+            && system_info->is_extension_available(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME)
+            && system_info->is_extension_available(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+    }
+
     vkb::Instance initialize_vulkan()
     {
         vkb::InstanceBuilder vk_instance_builder;
 
+        if (surface_maintenance_available()) {
+            vk_instance_builder.enable_extension(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+            vk_instance_builder.enable_extension(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+        }
+
         auto inst_ret = vk_instance_builder.set_app_name("Cioran")
             .request_validation_layers(true)
             .require_api_version(1, 1, 0)
@@ -39,6 +56,17 @@ namespace cioran {
         VkPhysicalDeviceVulkan12Features vk12_features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
         vk12_features.bufferDeviceAddress = true;
         vk12_features.descriptorIndexing = true;
+        // The bindless heap uses large descriptor arrays that are only partially filled, and updated while in use.
+        vk12_features.runtimeDescriptorArray = true;
+        vk12_features.descriptorBindingPartiallyBound = true;
+        vk12_features.descriptorBindingUpdateUnusedWhilePending = true;
+        vk12_features.descriptorBindingStorageImageUpdateAfterBind = true;
+        vk12_features.descriptorBindingSampledImageUpdateAfterBind = true;
+        vk12_features.descriptorBindingStorageBufferUpdateAfterBind = true;
+        vk12_features.shaderSampledImageArrayNonUniformIndexing = true;
+        vk12_features.shaderStorageImageArrayNonUniformIndexing = true;
+        vk12_features.shaderStorageBufferArrayNonUniformIndexing = true;
+        vk12_features.timelineSemaphore = true;
 
         // Use vkbootstrap to select a GPU
         // We want a GPU that can write to the SDL surface and supports Vulkan 1.3 with the correct features
@@ -54,13 +82,121 @@ namespace cioran {
         return physical_device;
     }
 
-    vkb::Swapchain create_swapchain(vkb::PhysicalDevice physicalDevice, VkDevice logicalDevice, VkSurfaceKHR surface, uint32_t window_width, uint32_t window_height, VkFormat& vk_swapchain_format)
+    VkPresentModeKHR choose_present_mode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkPresentModeKHR preferred_mode)
+    {
+        // FIFO is always supported, so if we can't query the surface we fall back to it.
+        uint32_t mode_count = 0;
+        if (vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &mode_count, nullptr) != VK_SUCCESS) {
+            std::cout << "Failed to query present modes, using fifo" << std::endl;
+            return VK_PRESENT_MODE_FIFO_KHR;
+        }
+        std::vector<VkPresentModeKHR> supported_modes(mode_count);
+        // VK_INCOMPLETE only means modes were added in between the two calls, the ones we got are still valid.
+        VkResult result = vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &mode_count, supported_modes.data());
+        if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+            std::cout << "Failed to query present modes, using fifo" << std::endl;
+            return VK_PRESENT_MODE_FIFO_KHR;
+        }
+        supported_modes.resize(mode_count);
+
+        // The present modes, in order of preference, for each requested mode.
+        // - IMMEDIATE presents right away and may tear. It's uncapped, so it's what we want for measuring.
+        // - MAILBOX replaces the queued image with the newest one. It doesn't tear, and has low latency at the display rate.
+        // - FIFO_RELAXED is vsync, but presents right away if a frame is late.
+        // - FIFO is vsync, and is the only mode that is guaranteed to be supported.
+        std::vector<VkPresentModeKHR> candidates;
+        switch (preferred_mode) {
+            case VK_PRESENT_MODE_IMMEDIATE_KHR:
+                candidates = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+                break;
+            case VK_PRESENT_MODE_MAILBOX_KHR:
+                candidates = { VK_PRESENT_MODE_MAILBOX_KHR };
+                break;
+            case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+                candidates = { VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+                break;
+            default:
+                break;
+        }
+
+        for (VkPresentModeKHR candidate : candidates) {
+            if (std::find(supported_modes.begin(), supported_modes.end(), candidate) != supported_modes.end()) {
+                return candidate;
+            }
+        }
+
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    bool enable_present_wait(vkb::PhysicalDevice& physical_device)
+    {
+        // Present id lets us tag each present with an id, and present wait lets us wait for an id to be displayed.
+        // Both are optional. If they aren't supported, frame pacing falls back to a plain frame limiter.
+        if (!physical_device.enable_extensions_if_present({ VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME })) {
+            return false;
+        }
+
+        VkPhysicalDevicePresentIdFeaturesKHR present_id_features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR };
+        present_id_features.presentId = true;
+
+        VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+        present_wait_features.presentWait = true;
+
+        return physical_device.enable_extension_features_if_present(present_id_features)
+            && physical_device.enable_extension_features_if_present(present_wait_features);
+    }
+
+    bool enable_swapchain_maintenance(vkb::PhysicalDevice& physical_device)
+    {
+        // Swapchain maintenance lets presents signal a fence when the presentation engine is done with them,
+        // which is what tells us when an old swapchain can be destroyed. Without it we fall back to present wait, or a device wait.
+        if (!surface_maintenance_available() || !physical_device.enable_extension_if_present(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchain_maintenance_features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT };
+        swapchain_maintenance_features.swapchainMaintenance1 = true;
+
+        return physical_device.enable_extension_features_if_present(swapchain_maintenance_features);
+    }
+
+    bool enable_descriptor_buffer(vkb::PhysicalDevice& physical_device)
+    {
+        // Descriptor buffers are optional. Without them, per frame descriptor sets come from descriptor pools.
+        if (!physical_device.enable_extension_if_present(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT };
+        descriptor_buffer_features.descriptorBuffer = true;
+
+        return physical_device.enable_extension_features_if_present(descriptor_buffer_features);
+    }
+
+    bool enable_push_descriptor(vkb::PhysicalDevice& physical_device)
+    {
+        // Push descriptors have no features to enable, only the extension. Nearly every desktop driver has it.
+        return physical_device.enable_extension_if_present(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    }
+
+    vkb::Swapchain create_swapchain(vkb::PhysicalDevice physicalDevice, VkDevice logicalDevice, VkSurfaceKHR surface, uint32_t window_width, uint32_t window_height, VkPresentModeKHR present_mode, uint32_t min_image_count, VkFormat& vk_swapchain_format, VkSwapchainKHR old_swapchain)
     {
         vkb::SwapchainBuilder swapchain_builder { physicalDevice, logicalDevice, surface };
 
+        // When recreating the swapchain, e.g. after a resize, the old swapchain is handed to the new one.
+        // This retires the old swapchain, and lets the presentation engine reuse its resources.
+        // The old swapchain still has to be destroyed by us once we are done with it.
+        swapchain_builder.set_old_swapchain(old_swapchain);
+
+        // More images lets the CPU and GPU run further ahead of the display, at the cost of latency.
+        // If no count is given, the builder picks one more than the minimum the surface supports.
+        if (min_image_count != 0) {
+            swapchain_builder.set_desired_min_image_count(min_image_count);
+        }
+
         vkb::Swapchain vkSwapChain = swapchain_builder
             .set_desired_format(VkSurfaceFormatKHR { .format = vk_swapchain_format, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR })
-            .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+            .set_desired_present_mode(present_mode)
             .set_desired_extent(window_width, window_height)
             .set_image_usage_flags(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
             .build()
@@ -117,15 +253,43 @@ namespace cioran {
         return image_view_create_info;
     }
 
-    VkCommandPool create_command_pool(VkDevice logicalDevice, uint32_t queue_family_index)
+    AllocatedBuffer create_buffer(VmaAllocator allocator, VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memory_usage, VmaAllocationCreateFlags allocation_flags)
+    {
+        VkBufferCreateInfo buffer_info {};
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size = size;
+        buffer_info.usage = usage;
+
+        // VMA picks the memory type from the memory usage, and the flags tell it how the host will access the memory.
+        // Buffers created with VMA_ALLOCATION_CREATE_MAPPED_BIT stay mapped for their whole lifetime.
+        VmaAllocationCreateInfo allocation_info {};
+        allocation_info.usage = memory_usage;
+        allocation_info.flags = allocation_flags;
+
+        AllocatedBuffer buffer {};
+        buffer.size = size;
+        if (vmaCreateBuffer(allocator, &buffer_info, &allocation_info, &buffer.buffer, &buffer.allocation, &buffer.info) != VK_SUCCESS) {
+            std::cout << "Failed to create buffer" << std::endl;
+            terminate();
+        }
+
+        return buffer;
+    }
+
+    void destroy_buffer(VmaAllocator allocator, const AllocatedBuffer& buffer)
+    {
+        vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+    }
+
+    VkCommandPool create_command_pool(VkDevice logicalDevice, uint32_t queue_family_index, VkCommandPoolCreateFlags flags)
     {
         // Create the command pool
         // A command pool can be seen as an allocator for command buffers.
         VkCommandPoolCreateInfo commandPoolInfo {};
         commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        // We indicate that we expect to be able to reset individual command buffers
+        // By default we indicate that we expect to be able to reset individual command buffers
         // made from this pool.
-        commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        commandPoolInfo.flags = flags;
         commandPoolInfo.queueFamilyIndex = queue_family_index;
 
         VkCommandPool command_pool;
@@ -1,5 +1,8 @@
 #include <iostream>
 #include <vector>
+#include <span>
+#include <algorithm>
+#include <thread>
 
 // Vulkan
 #include <vulkan/vulkan.hpp>
@@ -18,68 +21,196 @@
 #include "cioran-vulkan.h"
 #include "cioran-images.h"
 #include "cioran-descriptors.h"
+#include "cioran-descriptor-buffer.h"
+#include "cioran-frame-descriptors.h"
+#include "cioran-sync.h"
+#include "cioran-settings.h"
+#include "cioran-stats.h"
+#include "cioran-pacing.h"
+#include "cioran-commands.h"
+#include "cioran-jobs.h"
+#include "cioran-mailbox.h"
+#include "cioran-thread.h"
+#include "cioran-render-graph.h"
+#include "cioran-upload.h"
+#include "cioran-frame-allocator.h"
+#include "cioran-deferred.h"
+#include "cioran-resources.h"
+#include "cioran-bindless.h"
+#include "cioran-pipelines.h"
+#include "cioran-pipeline-cache.h"
+#include "cioran-layout-cache.h"
+#include "cioran-shader-reload.h"
+#include "cioran-swapchain.h"
 
 // Function prototypes
-VkFenceCreateInfo fence_create_info(VkFenceCreateFlags flags);
 VkSemaphoreCreateInfo semaphore_create_info(VkSemaphoreCreateFlags flags);
 VkCommandBufferBeginInfo command_buffer_begin_info(VkCommandBufferUsageFlags flags);
 VkImageSubresourceRange image_subresource_range(VkImageAspectFlags aspectMask);
-void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
 VkSemaphoreSubmitInfo semaphore_submit_info(VkPipelineStageFlags2 stageMask, VkSemaphore semaphore);
 VkCommandBufferSubmitInfo command_buffer_submit_info(VkCommandBuffer cmd);
-VkSubmitInfo2 submit_info(VkCommandBufferSubmitInfo* cmd, VkSemaphoreSubmitInfo* signalSemaphoreInfo, VkSemaphoreSubmitInfo* waitSemaphoreInfo);
+VkSubmitInfo2 submit_info(VkCommandBufferSubmitInfo* cmd, std::span<VkSemaphoreSubmitInfo> signalSemaphoreInfos, std::span<VkSemaphoreSubmitInfo> waitSemaphoreInfos);
 void vma_log_error(VkResult result);
 void init_descriptors();
+void init_pipelines();
+void render_thread_main();
+void create_swapchain(uint32_t width, uint32_t height);
+bool resize_swapchain();
+void submit_compute_work();
+VkExtent2D get_max_draw_extent(SDL_Window* window);
+
+// The state of the window and input devices, as seen by the main thread.
+// It's published to the render thread after each batch of window events.
+struct FrameInput {
+    bool quit_requested;
+    bool minimized;
+    uint32_t window_width;
+    uint32_t window_height;
+    // Incremented on every resize, so the render thread can tell that it missed one.
+    uint64_t resize_count;
+    // The mouse position in pixels, from the top left of the window.
+    float mouse_x;
+    float mouse_y;
+};
+
+void run_event_loop(SDL_Window* window);
+void handle_event(const SDL_Event& event, FrameInput& input);
+bool sample_input();
 
 struct FrameData {
-    VkCommandPool command_pool;
-    VkCommandBuffer command_buffer;
+    cioran::FrameCommands commands;
+    // Command buffers for the compute queue. Only used when there is a dedicated compute queue.
+    cioran::FrameCommands compute_commands;
     VkSemaphore swapchain_semaphore;
     VkSemaphore render_semaphore;
-    VkFence render_fence;
-    cioran::VkDeletionQueue deletion_queue;
+    // The value the graphics timeline reaches once the GPU has finished this frame's work.
+    uint64_t render_timeline_value;
+    // The value the compute timeline reaches once the frame's compute work is finished. 0 if the frame had none.
+    uint64_t compute_timeline_value;
+    // Per frame constants are allocated from here, and freed all at once when the frame slot comes around again.
+    cioran::FrameAllocator frame_allocator;
+    // Descriptor sets that only live for the frame are allocated from here, and freed all at once like the frame's constants.
+    cioran::FrameDescriptors descriptors;
 };
 
 VkInstance vk_instance;
 VkDevice vk_device;
 VkPhysicalDevice vk_physical_device;
+vkb::PhysicalDevice vkb_physical_device;
 
 VkDebugUtilsMessengerEXT vk_debug_messenger;
 VkSurfaceKHR vk_surface;
 
 VkSwapchainKHR vk_swapchain;
 VkFormat vk_swapchain_format;
+VkPresentModeKHR vk_present_mode;
 std::vector<VkImage> vk_swapchain_images;
+// The tracked state of each swapchain image, for building barriers.
+std::vector<cioran::ImageState> vk_swapchain_image_states;
 std::vector<VkImageView> vk_swapchain_image_views;
 VkExtent2D vk_swapchain_extent;
 
+bool resize_requested { false };
+
+// The main thread owns SDL and the window, the render thread owns everything that happens during a frame.
+// The main thread publishes input to the render thread through a mailbox, so neither ever blocks the other.
+cioran::Mailbox<FrameInput> input_mailbox {};
+// The render thread's copy of the latest input.
+FrameInput frame_input {};
+uint64_t handled_resize_count { 0 };
+
 VkQueue graphics_queue;
 uint32_t graphics_queue_family;
+cioran::QueueTimeline graphics_timeline {};
 
-int frame_number { 0 };
-constexpr unsigned int FRAME_OVERLAP { 2 };
+// The dedicated compute queue for async compute passes.
+// Without one, these are the same as the graphics queue, and compute passes run on the graphics queue.
+VkQueue compute_queue;
+uint32_t compute_queue_family;
+bool async_compute_enabled = false;
+cioran::QueueTimeline compute_timeline {};
+
+// The backend that was actually picked for per frame descriptor sets. Descriptor buffers need VK_EXT_descriptor_buffer, and push descriptors VK_KHR_push_descriptor.
+cioran::DescriptorBackend descriptor_backend = cioran::DescriptorBackend::pool;
+
+// Resources that change with every dispatch or draw are pushed straight into the command buffer, if the device supports it.
+cioran::PushDescriptorFunctions push_descriptor_functions {};
+
+// Uploads data to the GPU, on a dedicated transfer queue if there is one.
+cioran::UploadManager upload_manager {};
 
-FrameData frames[FRAME_OVERLAP];
+int frame_number { 0 };
+cioran::FrameStats frame_stats {};
+cioran::FramePacer frame_pacer {};
+// Old swapchains wait here until the presentation engine is done with them
+cioran::SwapchainRetirement swapchain_retirement {};
+
+// Runs per-frame CPU work, like command recording, across all cores
+cioran::JobSystem job_system {};
+// Runs slow work that must never end up inside a frame, like shader rebuilds and pipeline cache saves
+cioran::BackgroundQueue background_queue {};
+
+// The frame is described as a render graph, which is rebuilt and compiled every frame.
+cioran::RenderGraph render_graph {};
+
+// The number of frames in flight is chosen at startup from the render settings.
+cioran::RenderSettings render_settings {};
+std::vector<FrameData> frames;
 FrameData& get_current_frame() { 
-    return frames[frame_number % FRAME_OVERLAP];
+    return frames[frame_number % frames.size()];
 };
 
 cioran::VkDeletionQueue main_deletion_queue;
 
+// Objects that frames in flight might still be using, like an old swapchain, are retired here
+// and destroyed once the GPU has finished the frame they were retired in. Each frame is one epoch.
+cioran::DeferredDestroyer deferred_destroyer {};
+
+// Owns the long lived images and buffers, which the rest of the renderer refers to by handle.
+cioran::ResourceRegistry resource_registry {};
+
 VmaAllocator vma_allocator;
 
-cioran::AllocatedImage draw_image {};
+cioran::ImageHandle draw_image {};
 VkExtent2D draw_extent {};
 
 // Descriptor-Related Members
-cioran::DescriptorAllocator global_descriptor_allocator {};
-VkDescriptorSet draw_image_descriptors {};
-VkDescriptorSetLayout draw_image_descriptor_layout {};
+// Every descriptor set layout and pipeline layout comes from these, so identical layouts are created once and share a handle.
+cioran::DescriptorLayoutCache descriptor_layout_cache {};
+cioran::PipelineLayoutCache pipeline_layout_cache {};
+
+// Every image and buffer shaders access, in one descriptor set that is indexed with the resources' handles.
+cioran::BindlessHeap bindless_heap {};
+
+// Draws the background into the draw image.
+cioran::ComputeEffect gradient_effect {};
+// Lights up the draw image around the mouse, into a transient image of the render graph.
+cioran::ComputeEffect spotlight_effect {};
+// The spotlight's output image is bound through set 1, which is written for every dispatch.
+cioran::DispatchSetLayout spotlight_set_layout {};
+// The descriptors of set 1, packed the way spotlight_set_layout describes them.
+struct SpotlightDescriptors {
+    VkDescriptorImageInfo output_image;
+};
+
+// The radius of the spotlight, in pixels, and how dark the draw image gets outside of it.
+constexpr float SPOTLIGHT_RADIUS { 200.0f };
+constexpr float SPOTLIGHT_DARKNESS { 0.6f };
+
+// Keeps compiled pipelines across runs, so only the first launch pays for compiling them.
+cioran::PipelineCache pipeline_cache {};
+
+// Rebuilds effects in the background when their shaders are recompiled, if enabled in the settings.
+cioran::ShaderHotReload shader_hot_reload {};
 
 int window_height = 600;
 int window_width = 800;
 
 int main(int argc, char **argv) {
+    render_settings = cioran::parse_render_settings(argc, argv);
+    std::cout << "Latency mode: " << cioran::to_string(render_settings.latency_mode)
+        << ", frames in flight: " << render_settings.frames_in_flight << std::endl;
+
     // Initialize SDL
     if (SDL_Init(SDL_INIT_EVENTS | SDL_INIT_VIDEO) != 0) {
         const char* sdl_error = SDL_GetError();
@@ -92,7 +223,7 @@ int main(int argc, char **argv) {
     SDL_Window* window = SDL_CreateWindow(
         "Cioran",
         window_width, window_height,
-        SDL_WINDOW_VULKAN);
+        SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
 
     if (window == nullptr) {
         std::cout << "Failed to create window: " << SDL_GetError() << std::endl;
@@ -109,12 +240,31 @@ int main(int argc, char **argv) {
 
     // Get the physical device that we will use for rendering
     auto physical_device = cioran::get_physical_device(vulkan_init, vk_surface);
+    bool present_wait_enabled = cioran::enable_present_wait(physical_device);
+    bool swapchain_maintenance_enabled = cioran::enable_swapchain_maintenance(physical_device);
+    // The extension is only enabled when asked for, so the pool backend runs on exactly the same device setup as before.
+    if (render_settings.descriptor_backend == cioran::DescriptorBackend::buffer && cioran::enable_descriptor_buffer(physical_device)) {
+        descriptor_backend = cioran::DescriptorBackend::buffer;
+    }
+    bool push_descriptor_enabled = cioran::enable_push_descriptor(physical_device);
 
     // Create the final Vulkan device
     vkb::DeviceBuilder device_builder { physical_device };
     vkb::Device vkb_device = device_builder.build().value();
     vk_device = vkb_device.device;
+    if (push_descriptor_enabled) {
+        push_descriptor_functions.load(vk_device);
+    }
+    std::cout << "Push descriptors: " << (push_descriptor_functions.supported() ? "supported" : "not supported") << std::endl;
+    if (render_settings.descriptor_backend == cioran::DescriptorBackend::push && push_descriptor_functions.supported()) {
+        descriptor_backend = cioran::DescriptorBackend::push;
+    }
+    // The bindless heap and the frame's sets are in two different descriptor buffers, which some devices can't bind at once.
+    if (descriptor_backend == cioran::DescriptorBackend::buffer && !cioran::supports_frame_descriptor_buffers(physical_device.physical_device)) {
+        descriptor_backend = cioran::DescriptorBackend::pool;
+    }
     vk_physical_device = physical_device.physical_device;
+    vkb_physical_device = physical_device;
 
     // Initialize VMA
     VmaAllocatorCreateInfo allocatorInfo {};
@@ -133,26 +283,33 @@ int main(int argc, char **argv) {
         vmaDestroyAllocator(vma_allocator);
     });
 
+    deferred_destroyer.init(vk_device, vma_allocator);
+
+    // Initialize descriptors
+    // The registry writes the descriptors of the resources it creates into the bindless heap, so the heap comes first.
+    init_descriptors();
+    resource_registry.init(vk_device, vma_allocator, deferred_destroyer, &bindless_heap);
+
     // Create the swapchain
+    // The present mode is picked once from what the surface supports, and reused whenever the swapchain is recreated.
     vk_swapchain_format = VK_FORMAT_B8G8R8A8_UNORM;
-    auto swapchain = cioran::create_swapchain(physical_device, vk_device, vk_surface, window_width, window_height, vk_swapchain_format);
+    vk_swapchain = VK_NULL_HANDLE;
+    vk_present_mode = cioran::choose_present_mode(vk_physical_device, vk_surface, render_settings.present_mode);
+    std::cout << "Present mode: " << cioran::to_string(vk_present_mode)
+        << " (requested " << cioran::to_string(render_settings.present_mode) << ")" << std::endl;
 
-    vk_swapchain_extent = swapchain.extent;
-    vk_swapchain = swapchain.swapchain;
-    vk_swapchain_images = swapchain.get_images().value();
-    vk_swapchain_image_views = swapchain.get_image_views().value();
+    create_swapchain(window_width, window_height);
 
-    // Draw image size will match the window
+    // The draw image is sized to the largest extent the window can be resized to.
+    // That way resizing the window only recreates the swapchain, and we never have to reallocate
+    // the draw image. We simply render into the part of it that matches the swapchain.
+    VkExtent2D maxDrawExtent = get_max_draw_extent(window);
     VkExtent3D drawImageExtent = {
-        window_width,
-        window_height,
+        maxDrawExtent.width,
+        maxDrawExtent.height,
         1
     };
 
-    // Hardcoding the draw format to 32 bit float
-    draw_image.image_format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    draw_image.image_extent = drawImageExtent;
-
     // All images and buffers must fill in a UsageFlags with what they will be
     // used for. This allows the driver to perform optimizations in the background
     // depending on what that buffer or image is going to do later.
@@ -168,65 +325,80 @@ int main(int argc, char **argv) {
     // Specifically, it can be used as a color attachment in a render pass.
     drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    VkImageCreateInfo rimg_info = cioran::create_image_create_info(draw_image.image_format, drawImageUsages, drawImageExtent);
-    
-    // For the draw image, we want to allocate it from GPU local memory
-    VmaAllocationCreateInfo rimg_alloc_info = {};
-    // Specify that this is a texture that will never be accessed by the CPU.
-    rimg_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-    rimg_alloc_info.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    // Allocate and create the image
-    auto createImageResult = vmaCreateImage(vma_allocator, &rimg_info, &rimg_alloc_info, &draw_image.image, &draw_image.allocation, nullptr);
-    if (createImageResult != VK_SUCCESS) {
-        
-        vma_log_error(createImageResult);
-        terminate();
-    }
+    // Hardcoding the draw format to 16 bit float.
+    // The registry allocates it from GPU local memory, and builds an image view for it to use for rendering.
+    // It is destroyed together with the registry.
+    draw_image = resource_registry.create_image(VK_FORMAT_R16G16B16A16_SFLOAT, drawImageExtent, drawImageUsages, VK_IMAGE_ASPECT_COLOR_BIT);
 
-    // Build an image-view for the draw image to use for rendering
-    VkImageViewCreateInfo rview_info = cioran::create_image_view_create_info(draw_image.image_format, draw_image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+    // Get graphics queue
+    graphics_queue = vkb_device.get_queue(vkb::QueueType::graphics).value();
+    graphics_queue_family = vkb_device.get_queue_index(vkb::QueueType::graphics).value();
 
-    if (vkCreateImageView(vk_device, &rview_info, nullptr, &draw_image.image_view) != VK_SUCCESS) {
-        std::cout << "Failed to create image view" << std::endl;
-        terminate();
+    // Get a compute queue from a family without graphics support.
+    // These queues can run in parallel with the graphics queue on hardware with async compute.
+    auto compute_queue_result = vkb_device.get_queue(vkb::QueueType::compute);
+    if (render_settings.async_compute && compute_queue_result.has_value()) {
+        compute_queue = compute_queue_result.value();
+        compute_queue_family = vkb_device.get_queue_index(vkb::QueueType::compute).value();
+        async_compute_enabled = true;
+    } else {
+        compute_queue = graphics_queue;
+        compute_queue_family = graphics_queue_family;
+    }
+    std::cout << "Async compute: " << (async_compute_enabled ? "on" : "off") << std::endl;
+
+    // Get a transfer queue for uploads. A dedicated one is a family with nothing but transfer support,
+    // which on discrete GPUs is usually backed by copy engines that run in parallel with everything else.
+    // Without one, uploads fall back to a separate transfer family, and then to the graphics queue.
+    auto transfer_queue_result = vkb_device.get_dedicated_queue(vkb::QueueType::transfer);
+    auto transfer_queue_index_result = vkb_device.get_dedicated_queue_index(vkb::QueueType::transfer);
+    if (!transfer_queue_result.has_value()) {
+        transfer_queue_result = vkb_device.get_queue(vkb::QueueType::transfer);
+        transfer_queue_index_result = vkb_device.get_queue_index(vkb::QueueType::transfer);
     }
 
-    // Add image resources to deletion queue
-    main_deletion_queue.push_function([=]() {
-        std::cout << "Destroying draw image resources!" << std::endl;
-        vkDestroyImageView(vk_device, draw_image.image_view, nullptr);
-        vmaDestroyImage(vma_allocator, draw_image.image, draw_image.allocation);
-    });
+    if (transfer_queue_result.has_value()) {
+        upload_manager.init(vk_device, vma_allocator, transfer_queue_result.value(), transfer_queue_index_result.value(), graphics_queue_family);
+    } else {
+        upload_manager.init(vk_device, vma_allocator, graphics_queue, graphics_queue_family, graphics_queue_family);
+    }
+    std::cout << "Transfer queue: " << (transfer_queue_result.has_value() ? "separate" : "graphics") << std::endl;
 
-    // Get graphics queue
-    graphics_queue = vkb_device.get_queue(vkb::QueueType::graphics).value();
-    graphics_queue_family = vkb_device.get_queue_index(vkb::QueueType::graphics).value();
+    // Allocate the per-frame resources
+    frames.resize(render_settings.frames_in_flight);
 
-    // Create command structures
-    for (int i = 0; i < FRAME_OVERLAP; i++) {
-        // Create a command pool for each frame
-        auto command_pool = cioran::create_command_pool(vk_device, graphics_queue_family);
-        frames[i].command_pool = command_pool;
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(vk_physical_device, &device_properties);
+
+    // The starting ratios of descriptors per set. They adapt to what the frames actually allocate.
+    std::vector<cioran::DescriptorAllocator::PoolSizeRatio> frame_pool_ratios = {
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 }
+    };
 
-        // Allocate the default command buffer that we will use for rendering
-        auto command_buffer = cioran::create_command_buffer(vk_device, command_pool);
-        frames[i].command_buffer = command_buffer;
+    for (int i = 0; i < frames.size(); i++) {
+        frames[i].frame_allocator.init(vk_device, vma_allocator, cioran::DEFAULT_FRAME_ALLOCATOR_SIZE, device_properties.limits);
+        frames[i].descriptors.init(vk_device, vk_physical_device, vma_allocator, descriptor_backend, frame_pool_ratios, &push_descriptor_functions);
     }
+    std::cout << "Per frame descriptors: " << cioran::to_string(descriptor_backend)
+        << " (requested " << cioran::to_string(render_settings.descriptor_backend) << ")" << std::endl;
 
     // Initialize sync structures
-    // One fence to control when the GPU has finished rendering the frame,
-    // And 2 semaphores to synchronize rendering with swapchain.
-    // We want the fence to start signalled so we can wait on it on the first frame.
-    VkFenceCreateInfo fenceCreateInfo = fence_create_info(VK_FENCE_CREATE_SIGNALED_BIT);
+    // One timeline semaphore for the graphics queue to control when the GPU has finished rendering a frame,
+    // And 2 binary semaphores per frame to synchronize rendering with swapchain.
+    // Presentation does not support timeline semaphores, which is why the binary ones are still needed.
+    // Each frame starts out waiting for timeline value 0, which is always reached, so the first frames don't block.
+    graphics_timeline.init(vk_device);
+    compute_timeline.init(vk_device);
+
     VkSemaphoreCreateInfo semaphoreCreateInfo = semaphore_create_info(0);
 
-    for (int i = 0; i < FRAME_OVERLAP; i++)
+    for (int i = 0; i < frames.size(); i++)
     {
-        if (vkCreateFence(vk_device, &fenceCreateInfo, nullptr, &frames[i].render_fence) != VK_SUCCESS) {
-            std::cout << "Failed to create fence" << std::endl;
-            terminate();
-        }
+        frames[i].render_timeline_value = 0;
+        frames[i].compute_timeline_value = 0;
 
         if (vkCreateSemaphore(vk_device, &semaphoreCreateInfo, nullptr, &frames[i].swapchain_semaphore) != VK_SUCCESS) {
             std::cout << "Failed to create swapchain semaphore" << std::endl;
@@ -239,69 +411,238 @@ int main(int argc, char **argv) {
         }
     }
 
-    // Initialize descriptors
-    init_descriptors();
+    // Load the pipeline cache before any pipelines are created, so they can be taken from it.
+    pipeline_cache.init(vk_device, device_properties);
+
+    // Initialize the compute pipelines, which use the descriptor layouts
+    init_pipelines();
+
+    if (render_settings.shader_hot_reload) {
+        shader_hot_reload.init(vk_device, pipeline_cache.cache, CIORAN_SHADER_DIR);
+        shader_hot_reload.add_effect(gradient_effect);
+        shader_hot_reload.add_effect(spotlight_effect);
+    }
+
+    // The display's refresh rate is the starting guess for how often vblanks happen.
+    // The pacer refines it from actual present timings when present wait is available.
+    const SDL_DisplayMode* display_mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+    float refresh_rate = display_mode != nullptr ? display_mode->refresh_rate : 0.0f;
+
+    frame_pacer.init(vk_device, present_wait_enabled, render_settings.just_in_time_pacing, render_settings.fps_limit, refresh_rate);
+    std::cout << "Present wait: " << (present_wait_enabled ? "supported" : "not supported")
+        << ", just in time pacing: " << (frame_pacer.just_in_time ? "on" : "off") << std::endl;
+
+    swapchain_retirement.init(vk_device, swapchain_maintenance_enabled, frame_pacer.wait_for_present != nullptr);
+    std::cout << "Present fences: " << (swapchain_maintenance_enabled ? "supported" : "not supported") << std::endl;
+
+    frame_stats.init();
+
+    // The render thread starts out with the window size the swapchain was created for.
+    frame_input.window_width = (uint32_t)window_width;
+    frame_input.window_height = (uint32_t)window_height;
+
+    // Hand the frame loop over to the render thread.
+    // From here on, the main thread only processes window events, and passes the resulting input state on through the mailbox.
+    std::thread render_thread(render_thread_main);
+
+    run_event_loop(window);
+
+    render_thread.join();
+
+    // Destroy command pools
+    for (int i = 0; i < frames.size(); i++) {
+        frames[i].commands.destroy(vk_device);
+        if (async_compute_enabled) {
+            frames[i].compute_commands.destroy(vk_device);
+        }
+
+        // Destroy sync objects
+        vkDestroySemaphore(vk_device, frames[i].swapchain_semaphore, nullptr);
+        vkDestroySemaphore(vk_device, frames[i].render_semaphore, nullptr);
+
+        frames[i].frame_allocator.destroy(vma_allocator);
+        frames[i].descriptors.destroy(vma_allocator);
+    }
+
+    graphics_timeline.destroy(vk_device);
+    compute_timeline.destroy(vk_device);
+    upload_manager.destroy();
+
+    // Write the final state of the pipeline cache to disk.
+    pipeline_cache.destroy();
+
+    // The render thread waited for the device to go idle, so everything still retired or alive can go.
+    resource_registry.destroy();
+    deferred_destroyer.destroy();
+
+    main_deletion_queue.flush();
+
+    // Destroy swapchain resources
+    swapchain_retirement.destroy();
+    vkDestroySwapchainKHR(vk_device, vk_swapchain, nullptr);
+    for (int i = 0; i < vk_swapchain_image_views.size(); i++) {
+        vkDestroyImageView(vk_device, vk_swapchain_image_views[i], nullptr);
+    }
+
+    // Destroy surface
+    vkDestroySurfaceKHR(vk_instance, vk_surface, nullptr);
+
+    // Destroy Device
+    vkDestroyDevice(vk_device, nullptr);
+
+    // Destroy Debug Messenger
+    vkb::destroy_debug_utils_messenger(vk_instance, vk_debug_messenger);
+
+    // Destroy Instance
+    vkDestroyInstance(vk_instance, nullptr);
+
+    // Clean up SDL resources
+    SDL_Quit();    
+
+    return 0;
+}
+
+void render_thread_main() {
+    // The render thread can be pinned to a core and given a higher priority,
+    // so that other threads and processes don't delay the submission of frames.
+    if (render_settings.render_thread_cpu >= 0 && !cioran::set_current_thread_affinity((uint32_t)render_settings.render_thread_cpu)) {
+        std::cout << "Failed to set render thread affinity" << std::endl;
+    }
+
+    if (!cioran::set_current_thread_priority(render_settings.render_thread_priority)) {
+        std::cout << "Failed to set render thread priority" << std::endl;
+    }
+
+    // Start the job system. The render thread becomes thread 0, and helps out whenever it waits for jobs.
+    job_system.init(render_settings.worker_threads);
+    std::cout << "Job system threads: " << job_system.thread_count() << std::endl;
+    background_queue.init();
+
+    // Create command structures
+    // Each frame gets a command pool for its primary command buffer,
+    // and one for each job system thread to record secondary command buffers with.
+    for (int i = 0; i < frames.size(); i++) {
+        frames[i].commands.init(vk_device, graphics_queue_family, job_system.thread_count());
+        if (async_compute_enabled) {
+            frames[i].compute_commands.init(vk_device, compute_queue_family, job_system.thread_count());
+        }
+    }
+
+    render_graph.init(vk_device, vma_allocator, graphics_queue_family, compute_queue_family);
+
+    // In low latency mode, input is sampled after waiting for the GPU instead of before,
+    // so the input we act on is as fresh as possible when recording starts.
+    bool sample_input_late = render_settings.latency_mode == cioran::LatencyMode::low_latency;
 
     bool running = true;
     while (running) {
-        // SDL_PollEvent is the favored way of receving system events since it can be done from the main loop and does not suspend the main loop
-        // while waiting for an event to be posted.
-        // Common practice is to use a while loop to process all events in the event queue.
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_EVENT_QUIT) {
-                running = false;
-            }
+        if (!sample_input_late) {
+            running = sample_input();
         }
 
         // Draw
 
-        // Wait for the GPU to finish its rendering work with our fence
-        if (vkWaitForFences(vk_device, 1, &get_current_frame().render_fence, true, 1000000000) != VK_SUCCESS) {
-            std::cout << "Failed to wait for fence" << std::endl;
+        // Wait for the GPU to finish the rendering work that was last submitted for this frame.
+        // The timeline counter only ever grows, so unlike a fence there is nothing to reset afterwards.
+        if (!graphics_timeline.wait(vk_device, get_current_frame().render_timeline_value, 1000000000)) {
+            std::cout << "Timed out waiting for frame" << std::endl;
             terminate();
         }
 
-        get_current_frame().deletion_queue.flush();
-
-        // Reset the fence.
-        // Fences have to be reset between uses.
-        if (vkResetFences(vk_device, 1, &get_current_frame().render_fence) != VK_SUCCESS) {
-            std::cout << "Failed to reset fence" << std::endl;
+        // The graphics queue doesn't always wait for the frame's compute work, so it has to be waited for on its own.
+        if (!compute_timeline.wait(vk_device, get_current_frame().compute_timeline_value, 1000000000)) {
+            std::cout << "Timed out waiting for frame compute work" << std::endl;
             terminate();
         }
 
+        // Everything retired from now on belongs to this frame. The GPU has finished the frame that used this frame slot before,
+        // and every frame before it, so whatever was retired up to then can be destroyed.
+        deferred_destroyer.begin_epoch(frame_number);
+        if (frame_number >= frames.size()) {
+            deferred_destroyer.collect(frame_number - frames.size());
+            resource_registry.reclaim(frame_number - frames.size());
+        }
+        swapchain_retirement.collect(frame_pacer.last_displayed_id);
+
+        // Nothing has been recorded for this frame yet, so this is where rebuilt pipelines can be swapped in.
+        if (render_settings.shader_hot_reload) {
+            shader_hot_reload.update(background_queue, deferred_destroyer);
+        }
+
+        // Write the descriptors of resources created since the last frame, so this frame's shaders can index them.
+        bindless_heap.flush();
+
+        // The GPU is done with the frame's constants and descriptor sets, so the frame allocators can start over.
+        get_current_frame().frame_allocator.reset();
+        get_current_frame().descriptors.reset();
+
+        // Delay the start of the frame's CPU work, so that it's done just in time for its vblank.
+        // This has to happen before input is sampled, so the input is as fresh as possible.
+        frame_pacer.wait_for_frame_start(vk_device, vk_swapchain);
+
+        // A quit that arrives while we wait for the frame start must not get one more frame rendered.
+        if (sample_input_late) {
+            running = sample_input();
+            if (!running) {
+                break;
+            }
+        }
+
+        if (resize_requested) {
+            // If the window is minimized there is nothing to present to,
+            // so we skip the frame without spinning the CPU.
+            if (!resize_swapchain()) {
+                SDL_Delay(10);
+                continue;
+            }
+        }
+
         // Request presentable image from the swapchain
         // vkAcquireNextImageKHR will block the thread with a maximum for the timeout set in the case that no images are available for use.
         // The semaphore is used to singal when the presentation engine is finished reading from the image.
         // This is because when you aquire the image, the presentation engine might still be reading from it.
         // This semaphore has to be used in the command buffer to make sure nothing tampers with the memory before its signalled.
+        // VK_ERROR_OUT_OF_DATE_KHR means the swapchain no longer matches the surface, and can't be presented to.
+        // In that case the semaphore is not signaled, so we can simply recreate the swapchain and try again next iteration.
+        // VK_SUBOPTIMAL_KHR means we got an image which can still be presented, but the swapchain no longer matches the surface exactly.
+        // We render and present this frame as usual, and recreate the swapchain afterwards.
         uint32_t swapchain_image_index;
-        if (vkAcquireNextImageKHR(
+        VkResult acquireResult = vkAcquireNextImageKHR(
             vk_device,
             vk_swapchain,
             1000000000,
             get_current_frame().swapchain_semaphore,
             VK_NULL_HANDLE,
-            &swapchain_image_index) != VK_SUCCESS)
-        {
+            &swapchain_image_index);
+
+        if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+            resize_requested = true;
+            continue;
+        } else if (acquireResult == VK_SUBOPTIMAL_KHR) {
+            resize_requested = true;
+        } else if (acquireResult != VK_SUCCESS) {
             std::cout << "Failed to acquire next image" << std::endl;
             terminate();
         }
 
-        VkCommandBuffer cmd = get_current_frame().command_buffer;
+        frame_stats.begin_cpu_work();
+        uint64_t present_id = frame_pacer.begin_frame();
 
-        draw_extent.width = draw_image.image_extent.width;
-        draw_extent.height = draw_image.image_extent.height;
+        // We only render to the part of the draw image that is visible in the swapchain
+        cioran::AllocatedImage& draw_image_resource = resource_registry.get(draw_image);
+        draw_extent.width = std::min(vk_swapchain_extent.width, draw_image_resource.image_extent.width);
+        draw_extent.height = std::min(vk_swapchain_extent.height, draw_image_resource.image_extent.height);
 
         // Now that we are sure that the commands finished executing, we can safely
-        // reset the command buffer to begin recording again.
-        // Resetting the buffer will completely remove all commands and free its memory.
-        if (vkResetCommandBuffer(cmd, 0) != VK_SUCCESS) {
-            std::cout << "Failed to reset command buffer" << std::endl;
-            terminate();
+        // reset the frame's command pools to begin recording again.
+        // Resetting a pool recycles all of the command buffers allocated from it in one call.
+        get_current_frame().commands.reset(vk_device);
+        if (async_compute_enabled) {
+            get_current_frame().compute_commands.reset(vk_device);
         }
 
+        VkCommandBuffer cmd = get_current_frame().commands.primary;
+
         // Begin the command buffer recording.
         // We will use this command buffer exactly once, so we want to let Vulkan know that.
         VkCommandBufferBeginInfo cmdBeginInfo = command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
@@ -312,38 +653,120 @@ int main(int argc, char **argv) {
             terminate();
         }
 
-        // Make the swapchain image into writeable mode before rending
-        // Newly created images will be in the VK_IMAGE_LAYOUT_UNDEFINED (the don't care layout)
-        // The new layout is VK_IMAGE_LAYOUT_GENERAL.
-        // This is a general purpose layout which allows for reading and writing from the image.
-        // It's not the most optimal layout for rendering, but it's a good starting point.
-        //transition_image(cmd, vk_swapchain_images[swapchain_image_index], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        // Submit the uploads requested since the last frame, and take over the ones that have finished.
+        // The acquires have to be recorded before the graph is compiled, since they change the state of the uploaded resources.
+        upload_manager.flush();
 
-        transition_image(cmd, draw_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        cioran::BarrierBatch upload_acquires;
+        VkPipelineStageFlags2 upload_wait_stage = VK_PIPELINE_STAGE_2_NONE;
+        uint64_t upload_wait_value = upload_manager.acquire_completed_uploads(upload_acquires, upload_wait_stage);
+        upload_acquires.flush(cmd);
 
-        // Make a clear color from frame number.
-        // This will flash!
-        VkClearColorValue clearColor;
-        float flash = std::abs(std::sin(frame_number / 120.0f));
-        clearColor = { { 0.0f, 0.0f, flash, 1.0f } };
+        // Describe the frame as a render graph. The passes declare how they use the images,
+        // and compiling the graph places the barriers between them.
+        render_graph.reset();
+
+        // Passes bind the heap and their sets through the frame's descriptors, whichever backend holds them.
+        cioran::FrameDescriptors& frame_descriptors = get_current_frame().descriptors;
 
-        VkImageSubresourceRange subresourceRange = image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+        // The swapchain image is acquired at the stage the swapchain semaphore is waited on. Its contents are overwritten,
+        // so the transition to the transfer layout only has to chain with that wait, to not start before the presentation engine is done with the image.
+        cioran::ImageState& swapchain_image_state = vk_swapchain_image_states[swapchain_image_index];
+        swapchain_image_state.stage = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        swapchain_image_state.access = VK_ACCESS_2_NONE;
 
-        // Clear image
-        vkCmdClearColorImage(cmd, draw_image.image, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &subresourceRange);
+        cioran::GraphImage graph_draw_image = render_graph.import_image(draw_image_resource.image, draw_image_resource.image_view, draw_image_resource.state);
+        cioran::GraphImage graph_swapchain_image = render_graph.import_image(
+            vk_swapchain_images[swapchain_image_index], vk_swapchain_image_views[swapchain_image_index], swapchain_image_state);
 
-        // Make the swapchain image into presentable mode
         // The swapchain only allows layouts in the form of VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for presenting to the screen.
-        //transition_image(cmd, vk_swapchain_images[swapchain_image_index], VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        render_graph.mark_output(graph_swapchain_image, cioran::ImageUsage::present);
 
-        transition_image(cmd, draw_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-        transition_image(cmd, vk_swapchain_images[swapchain_image_index], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        // Draw the background with the gradient effect.
+        // Its colors are written into the frame allocator, and the shader finds them through the address in its push constants,
+        // so animating them doesn't touch any descriptors.
+        float flash = std::abs(std::sin(frame_number / 120.0f));
+        cioran::ComputeParameters gradient_parameters = {
+            .data1 = { 1.0f, 0.0f, flash, 1.0f },
+            .data2 = { 0.0f, 0.0f, 1.0f - flash, 1.0f }
+        };
+        gradient_effect.data = {
+            .indices = { draw_image.index() },
+            .parameters = get_current_frame().frame_allocator.push(gradient_parameters).address
+        };
+
+        cioran::RenderGraphPass& background_pass = render_graph.add_pass("background");
+        background_pass.queue = cioran::PassQueue::async_compute;
+        background_pass.write(graph_draw_image, cioran::ImageUsage::compute_storage_write, true);
+        background_pass.record = [&](VkCommandBuffer secondary) {
+            frame_descriptors.bind_heap(secondary, VK_PIPELINE_BIND_POINT_COMPUTE, gradient_effect.layout, bindless_heap);
+            gradient_effect.dispatch(secondary, draw_extent);
+        };
+
+        // Light up the draw image around the mouse. The lit image is only needed until it's copied to the swapchain,
+        // so it's a transient image: the graph owns it, and can place it in memory shared with other transient images.
+        cioran::GraphImage graph_lit_image = render_graph.create_image({
+            .format = draw_image_resource.image_format,
+            .extent = draw_image_resource.image_extent,
+            .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+        });
+
+        cioran::ComputeParameters spotlight_parameters = {
+            .data1 = { frame_input.mouse_x, frame_input.mouse_y, SPOTLIGHT_RADIUS, SPOTLIGHT_DARKNESS }
+        };
+        spotlight_effect.data = {
+            .indices = { draw_image.index() },
+            .parameters = get_current_frame().frame_allocator.push(spotlight_parameters).address
+        };
+
+        // The set holding the lit image is written once the graph is compiled, which is when the image gets a view.
+        cioran::DispatchSet spotlight_set {};
+
+        cioran::RenderGraphPass& spotlight_pass = render_graph.add_pass("spotlight");
+        spotlight_pass.read(graph_draw_image, cioran::ImageUsage::compute_storage_read);
+        spotlight_pass.write(graph_lit_image, cioran::ImageUsage::compute_storage_write, true);
+        spotlight_pass.record = [&](VkCommandBuffer secondary) {
+            frame_descriptors.bind_heap(secondary, VK_PIPELINE_BIND_POINT_COMPUTE, spotlight_effect.layout, bindless_heap);
+            frame_descriptors.bind(secondary, VK_PIPELINE_BIND_POINT_COMPUTE, spotlight_effect.layout, 1, spotlight_set);
+            spotlight_effect.dispatch(secondary, draw_extent);
+        };
+
+        // Copy the lit image to the swapchain
+        cioran::RenderGraphPass& copy_pass = render_graph.add_pass("copy to swapchain");
+        copy_pass.read(graph_lit_image, cioran::ImageUsage::transfer_src);
+        copy_pass.write(graph_swapchain_image, cioran::ImageUsage::transfer_dst, true);
+        copy_pass.record = [&](VkCommandBuffer secondary) {
+            // Execute a copy from the lit image into the swapchain
+            cioran::copy_image_to_image(secondary, render_graph.get_image(graph_lit_image), vk_swapchain_images[swapchain_image_index], draw_extent, vk_swapchain_extent);
+        };
+
+        // Transient images retired by the graph are destroyed once this frame has finished on the GPU,
+        // which is after every earlier frame that could have used them.
+        render_graph.compile(deferred_destroyer);
+
+        // Write the sets of the frame's transient images, now that they exist, and before any pass is recorded.
+        // Pushed sets are read from the struct while the passes are recorded, which happens before it goes out of scope.
+        SpotlightDescriptors spotlight_descriptors = {
+            .output_image = { VK_NULL_HANDLE, render_graph.get_image_view(graph_lit_image), VK_IMAGE_LAYOUT_GENERAL }
+        };
+        spotlight_set = frame_descriptors.write(spotlight_set_layout, spotlight_descriptors);
+
+        // The frame's constants and descriptors are all written while building the graph. Make them visible to the GPU before anything is submitted.
+        get_current_frame().frame_allocator.flush(vma_allocator);
+        frame_descriptors.flush(vma_allocator);
+
+        // The compute passes are recorded and submitted to the compute queue first, so they can start while the graphics work is still recorded.
+        get_current_frame().compute_timeline_value = 0;
+        if (render_graph.has_compute_work()) {
+            submit_compute_work();
+        }
 
-        // Execute a copy from the draw image into the swapchain
-        cioran::copy_image_to_image(cmd, draw_image.image, vk_swapchain_images[swapchain_image_index], draw_extent, vk_swapchain_extent);
-        
-        // set swapchain image layout to present so we can show it on the screen
-        transition_image(cmd, vk_swapchain_images[swapchain_image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        // The passes are recorded into secondary command buffers on the job system,
+        // which the primary command buffer executes in declaration order.
+        // Recording is the only frame work on the job system so far. The renderer has no object culling or asset decoding yet,
+        // and upload_manager.flush() above stays on the render thread, since it only submits copies that were staged when they were requested.
+        // New per-frame CPU work is meant to go through job_system, like the pass recording does.
+        render_graph.execute(cioran::PassQueue::graphics, vk_device, cmd, get_current_frame().commands, job_system);
 
         // Finalize the command buffer (we can no longer add commands, but it can now be executed)
         if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
@@ -357,23 +780,41 @@ int main(int argc, char **argv) {
         VkCommandBufferSubmitInfo cmdSubmitInfo = command_buffer_submit_info(cmd);
 
         // The wait_swapchain_semaphore will be provided as a wait semaphore to the submit command.
-        // In this case, it means that all commands BEFORE VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR stage
+        // In this case, it means that all commands BEFORE VK_PIPELINE_STAGE_2_TRANSFER_BIT stage
         // is allowed to execute, but the pipeline will be stalled at this stage until the semaphore is signalled.
-        // VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR == The stage where, besides other things, final color output is written.
+        // The first write to the swapchain image is the blit from the draw image, which happens in the transfer stage.
         // In this case, we need to make sure that the swapchain is done reading from the image data before we write new data to it.
-        VkSemaphoreSubmitInfo wait_swapchain_semaphore = semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, get_current_frame().swapchain_semaphore);
+        // This has to match the stage the swapchain image state is set to after acquiring it, so the barrier chains with the wait.
+        VkSemaphoreSubmitInfo wait_swapchain_semaphore = semaphore_submit_info(VK_PIPELINE_STAGE_2_TRANSFER_BIT, get_current_frame().swapchain_semaphore);
+
+        // Here, we specify that once all commands are done, we singal the render semaphore for presentation,
+        // and advance the graphics timeline to a new value that marks this frame as finished.
+        // We wait for that value in the beginning of the render loop to make sure the pipeline has completed rendering before we
+        // reuse the frame's resources.
+        get_current_frame().render_timeline_value = graphics_timeline.next_signal_value();
+
+        VkSemaphoreSubmitInfo signal_semaphores[] = {
+            // The transition to the present layout waits for no stage, so the signal has to cover all commands to include it.
+            semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, get_current_frame().render_semaphore),
+            graphics_timeline.signal_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, get_current_frame().render_timeline_value)
+        };
+
+        // Resources handed over by the compute queue can only be used once the compute work that released them has finished.
+        std::vector<VkSemaphoreSubmitInfo> wait_semaphores = { wait_swapchain_semaphore };
+        if (render_graph.graphics_wait_stage != VK_PIPELINE_STAGE_2_NONE && compute_timeline.last_submitted_value > 0) {
+            wait_semaphores.push_back(compute_timeline.wait_info(render_graph.graphics_wait_stage, compute_timeline.last_submitted_value));
+        }
 
-        // Here, we specify that once all graphic pipeline stages are done, we singal this semaphore.
-        VkSemaphoreSubmitInfo signal_render_semaphore = semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, get_current_frame().render_semaphore);
+        // The acquires of finished uploads have to be ordered after their release on the transfer queue.
+        if (upload_wait_value > 0) {
+            wait_semaphores.push_back(upload_manager.timeline.wait_info(upload_wait_stage, upload_wait_value));
+        }
 
-        VkSubmitInfo2 submit = submit_info(&cmdSubmitInfo, &signal_render_semaphore, &wait_swapchain_semaphore);
+        VkSubmitInfo2 submit = submit_info(&cmdSubmitInfo, signal_semaphores, wait_semaphores);
 
         // Submit the command buffer to the queue and execute it
-        // render fence will now block until the graphic commands finish execution
-        // The fence will be signaled once all submitted command buffers have completed execution.
-        // We use this fence in the beginning of the render loop to make sure the pipeline has completed rendering before we
-        // render a new frame.
-        if (vkQueueSubmit2(graphics_queue, 1, &submit, get_current_frame().render_fence) != VK_SUCCESS) {
+        // No fence is needed, since completion is tracked by the timeline semaphore.
+        if (vkQueueSubmit2(graphics_queue, 1, &submit, VK_NULL_HANDLE) != VK_SUCCESS) {
             std::cout << "Failed to submit to queue" << std::endl;
             terminate();
         }
@@ -392,54 +833,222 @@ int main(int argc, char **argv) {
 
         presentInfo.pImageIndices = &swapchain_image_index;
 
-        if (vkQueuePresentKHR(graphics_queue, &presentInfo) != VK_SUCCESS) {
+        // Tag the present with an id, so the pacer can wait for it to be displayed.
+        VkPresentIdKHR presentIdInfo = frame_pacer.present_id_info(&present_id);
+        if (frame_pacer.wait_for_present != nullptr) {
+            presentInfo.pNext = &presentIdInfo;
+        }
+
+        // The fence signals once the presentation engine is done with this present, so old swapchains know when they can go.
+        VkFence presentFence = VK_NULL_HANDLE;
+        VkSwapchainPresentFenceInfoEXT presentFenceInfo {};
+        if (swapchain_retirement.present_fences) {
+            presentFence = swapchain_retirement.next_present_fence();
+            presentFenceInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+            presentFenceInfo.pNext = presentInfo.pNext;
+            presentFenceInfo.swapchainCount = 1;
+            presentFenceInfo.pFences = &presentFence;
+            presentInfo.pNext = &presentFenceInfo;
+        }
+
+        VkResult presentResult = vkQueuePresentKHR(graphics_queue, &presentInfo);
+        if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR) {
+            resize_requested = true;
+        } else if (presentResult != VK_SUCCESS) {
             std::cout << "Failed to present image" << std::endl;
             terminate();
         }
 
+        if (render_settings.benchmark) {
+            double latency_ms = 0.0;
+            if (frame_pacer.take_latency_sample(latency_ms)) {
+                frame_stats.record_latency(latency_ms);
+            }
+            frame_stats.end_frame();
+        }
+
+        // Pipelines created since the last save are written to disk in the background every now and then,
+        // so a crash doesn't lose them.
+        pipeline_cache.save_periodically(background_queue);
+
         frame_number++;
     }
 
     // Make sure that the GPU has stopped doing its things
     vkDeviceWaitIdle(vk_device);
 
-    // Destroy command pools
-    // Destroying the pools will also destroy the command buffers allocated from them
-    for (int i = 0; i < FRAME_OVERLAP; i++) {
-        vkDestroyCommandPool(vk_device, frames[i].command_pool, nullptr);
+    render_graph.destroy();
+    if (render_settings.shader_hot_reload) {
+        shader_hot_reload.destroy();
+    }
+    pipeline_cache.wait_for_save();
+    background_queue.shutdown();
+    job_system.shutdown();
+}
 
-        // Destroy sync objects
-        vkDestroyFence(vk_device, frames[i].render_fence, nullptr);
-        vkDestroySemaphore(vk_device, frames[i].swapchain_semaphore, nullptr);
-        vkDestroySemaphore(vk_device, frames[i].render_semaphore, nullptr);
+void run_event_loop(SDL_Window* window) {
+    FrameInput input {};
+
+    int width, height;
+    SDL_GetWindowSizeInPixels(window, &width, &height);
+    input.window_width = (uint32_t)width;
+    input.window_height = (uint32_t)height;
+    input.minimized = (SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED) != 0;
+
+    while (!input.quit_requested) {
+        // The main thread has nothing else to do, so it sleeps until there are events.
+        // Once woken up, we process every event in the queue before publishing the new input state.
+        SDL_Event event;
+        if (!SDL_WaitEventTimeout(&event, 100)) {
+            continue;
+        }
+
+        do {
+            handle_event(event, input);
+        } while (SDL_PollEvent(&event));
 
-        frames[i].deletion_queue.flush();
+        input_mailbox.publish(input);
     }
+}
 
-    main_deletion_queue.flush();
+void handle_event(const SDL_Event& event, FrameInput& input) {
+    switch (event.type) {
+        case SDL_EVENT_QUIT:
+            input.quit_requested = true;
+            break;
+        case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+            input.window_width = (uint32_t)event.window.data1;
+            input.window_height = (uint32_t)event.window.data2;
+            input.resize_count++;
+            break;
+        case SDL_EVENT_WINDOW_MINIMIZED:
+            input.minimized = true;
+            break;
+        case SDL_EVENT_WINDOW_RESTORED:
+            input.minimized = false;
+            input.resize_count++;
+            break;
+        case SDL_EVENT_MOUSE_MOTION: {
+            // Mouse positions are in window coordinates, which are smaller than pixels on high density displays.
+            // The renderer works in pixels, so they're scaled by the pixel density.
+            SDL_Window* window = SDL_GetWindowFromID(event.motion.windowID);
+            float pixel_density = window != nullptr ? SDL_GetWindowPixelDensity(window) : 0.0f;
+            if (pixel_density <= 0.0f) {
+                pixel_density = 1.0f;
+            }
+            input.mouse_x = event.motion.x * pixel_density;
+            input.mouse_y = event.motion.y * pixel_density;
+            break;
+        }
+        default:
+            break;
+    }
+}
 
-    // Destroy swapchain resources
-    vkDestroySwapchainKHR(vk_device, vk_swapchain, nullptr);
-    for (int i = 0; i < vk_swapchain_image_views.size(); i++) {
-        vkDestroyImageView(vk_device, vk_swapchain_image_views[i], nullptr);
+bool sample_input() {
+    // Pick up the latest input state from the main thread, if there is a new one.
+    // Events that happened since the last frame are already folded into it.
+    if (input_mailbox.try_receive(frame_input)) {
+        if (frame_input.resize_count != handled_resize_count) {
+            handled_resize_count = frame_input.resize_count;
+            resize_requested = true;
+        }
     }
 
-    // Destroy surface
-    vkDestroySurfaceKHR(vk_instance, vk_surface, nullptr);
+    return !frame_input.quit_requested;
+}
 
-    // Destroy Device
-    vkDestroyDevice(vk_device, nullptr);
+void create_swapchain(uint32_t width, uint32_t height) {
+    // Passing the current swapchain as the old swapchain allows the driver to reuse its resources,
+    // and lets frames that are still presenting from it finish.
+    auto swapchain = cioran::create_swapchain(
+        vkb_physical_device, vk_device, vk_surface, width, height,
+        vk_present_mode, render_settings.swapchain_image_count, vk_swapchain_format, vk_swapchain);
 
-    // Destroy Debug Messenger
-    vkb::destroy_debug_utils_messenger(vk_instance, vk_debug_messenger);
+    vk_swapchain_extent = swapchain.extent;
+    vk_swapchain = swapchain.swapchain;
+    vk_swapchain_images = swapchain.get_images().value();
+    vk_swapchain_image_states.assign(vk_swapchain_images.size(), cioran::ImageState {});
+    vk_swapchain_image_views = swapchain.get_image_views().value();
 
-    // Destroy Instance
-    vkDestroyInstance(vk_instance, nullptr);
+    if (render_settings.benchmark) {
+        std::cout << "Swapchain: " << vk_swapchain_extent.width << "x" << vk_swapchain_extent.height
+            << ", " << vk_swapchain_images.size() << " images" << std::endl;
+    }
+}
 
-    // Clean up SDL resources
-    SDL_Quit();    
+void submit_compute_work() {
+    VkCommandBuffer compute_cmd = get_current_frame().compute_commands.primary;
 
-    return 0;
+    VkCommandBufferBeginInfo begin_info = command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    if (vkBeginCommandBuffer(compute_cmd, &begin_info) != VK_SUCCESS) {
+        std::cout << "Failed to begin compute command buffer" << std::endl;
+        terminate();
+    }
+
+    render_graph.execute(cioran::PassQueue::async_compute, vk_device, compute_cmd, get_current_frame().compute_commands, job_system);
+
+    if (vkEndCommandBuffer(compute_cmd) != VK_SUCCESS) {
+        std::cout << "Failed to end compute command buffer" << std::endl;
+        terminate();
+    }
+
+    VkCommandBufferSubmitInfo compute_cmd_info = command_buffer_submit_info(compute_cmd);
+
+    // Resources taken over from the graphics queue can still be in use by the graphics work of earlier frames.
+    // Everything submitted to the graphics queue so far is covered by its last submitted timeline value.
+    std::vector<VkSemaphoreSubmitInfo> wait_semaphores;
+    if (render_graph.compute_wait_stage != VK_PIPELINE_STAGE_2_NONE && graphics_timeline.last_submitted_value > 0) {
+        wait_semaphores.push_back(graphics_timeline.wait_info(render_graph.compute_wait_stage, graphics_timeline.last_submitted_value));
+    }
+
+    get_current_frame().compute_timeline_value = compute_timeline.next_signal_value();
+    VkSemaphoreSubmitInfo signal_semaphore = compute_timeline.signal_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, get_current_frame().compute_timeline_value);
+
+    VkSubmitInfo2 submit = submit_info(&compute_cmd_info, { &signal_semaphore, 1 }, wait_semaphores);
+
+    if (vkQueueSubmit2(compute_queue, 1, &submit, VK_NULL_HANDLE) != VK_SUCCESS) {
+        std::cout << "Failed to submit to compute queue" << std::endl;
+        terminate();
+    }
+}
+
+bool resize_swapchain() {
+    uint32_t width = frame_input.window_width;
+    uint32_t height = frame_input.window_height;
+
+    // A minimized window has a zero sized surface, which a swapchain can't be created for.
+    if (width == 0 || height == 0 || frame_input.minimized) {
+        return false;
+    }
+
+    // The old swapchain can still be used by presents that are queued, so it's handed over to be destroyed once they completed.
+    // The new swapchain is created from it first, which needs it to still be alive.
+    VkSwapchainKHR old_swapchain = vk_swapchain;
+    std::vector<VkImageView> old_image_views = vk_swapchain_image_views;
+
+    create_swapchain(width, height);
+    swapchain_retirement.retire(old_swapchain, old_image_views, frame_pacer.present_id + 1);
+    frame_pacer.on_swapchain_recreated();
+
+    resize_requested = false;
+
+    return true;
+}
+
+VkExtent2D get_max_draw_extent(SDL_Window* window) {
+    int width, height;
+    SDL_GetWindowSizeInPixels(window, &width, &height);
+
+    // The largest size the window can reasonably get is the size of the display it's on.
+    // The desktop mode is in screen coordinates, so it's scaled by the pixel density to get the size in pixels.
+    const SDL_DisplayMode* mode = SDL_GetDesktopDisplayMode(SDL_GetDisplayForWindow(window));
+    if (mode != nullptr) {
+        width = std::max(width, (int)(mode->w * mode->pixel_density));
+        height = std::max(height, (int)(mode->h * mode->pixel_density));
+    }
+
+    return VkExtent2D { (uint32_t)width, (uint32_t)height };
 }
 
 void vma_log_error(VkResult result) {
@@ -500,15 +1109,15 @@ VkCommandBufferSubmitInfo command_buffer_submit_info(VkCommandBuffer cmd) {
     return cmdSubmitInfo;
 }
 
-VkSubmitInfo2 submit_info(VkCommandBufferSubmitInfo* cmd, VkSemaphoreSubmitInfo* signalSemaphoreInfo, VkSemaphoreSubmitInfo* waitSemaphoreInfo) {
+VkSubmitInfo2 submit_info(VkCommandBufferSubmitInfo* cmd, std::span<VkSemaphoreSubmitInfo> signalSemaphoreInfos, std::span<VkSemaphoreSubmitInfo> waitSemaphoreInfos) {
     VkSubmitInfo2 submitInfo {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
 
-    submitInfo.waitSemaphoreInfoCount = waitSemaphoreInfo == nullptr ? 0 : 1;
-    submitInfo.pWaitSemaphoreInfos = waitSemaphoreInfo;
+    submitInfo.waitSemaphoreInfoCount = (uint32_t)waitSemaphoreInfos.size();
+    submitInfo.pWaitSemaphoreInfos = waitSemaphoreInfos.data();
 
-    submitInfo.signalSemaphoreInfoCount = signalSemaphoreInfo == nullptr ? 0 : 1;
-    submitInfo.pSignalSemaphoreInfos = signalSemaphoreInfo;
+    submitInfo.signalSemaphoreInfoCount = (uint32_t)signalSemaphoreInfos.size();
+    submitInfo.pSignalSemaphoreInfos = signalSemaphoreInfos.data();
 
     submitInfo.commandBufferInfoCount = cmd == nullptr ? 0 : 1;
     submitInfo.pCommandBufferInfos = cmd;
@@ -527,50 +1136,6 @@ VkImageSubresourceRange image_subresource_range(VkImageAspectFlags aspectMask) {
     return subImage;
 }
 
-void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout) {
-    // VkImageMemoryBarrier is a type of memory barrier.
-    // It is specialized in handling a layout transition between stage and memory access dependencies.
-    // A memory barrier can ensure correct ordering of memory operations between different stages in the graphics pipeline,
-    // and even between different command buffers.
-
-    // Memory barriers have the following important components:
-    // - Source Stage Mask: The pipeline stages that must be complete before the barrier.
-    // - Source Access Mask: The types of memory access that must be complete within the source stage mask before the barrier.
-    // - Destination Stage Mask: Specifies the pipeline stages that must wait for the barrier.
-    // - Destination Access Mask: Specifies the types of memory access within the destination stage that must wait for the barrier.
-
-    // The VkImageMemoryBarrier additionally has an old and new layout transition, which will happen
-    // after the source masks, but before the destination masks.
-    VkImageMemoryBarrier2 imageBarrier {};
-    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
-
-    // VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT = We wait for all commands in all stages to complete.
-    // VK_ACCESS_2_MEMORY_WRITE_BIT = All memory write commands within all stages must be complete
-    imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-    imageBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
-
-    // VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT = All commands for all stages must wait for sources + transition to complete
-    // And both read and write operations of all commands in all stages must wait for sources + to complete
-    imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-    imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
-
-    // Transition the memory layout from the current layout to a new layout
-    imageBarrier.oldLayout = currentLayout;
-    imageBarrier.newLayout = newLayout;
-
-    VkImageAspectFlags aspectMask = (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
-
-    imageBarrier.subresourceRange = image_subresource_range(aspectMask);
-    imageBarrier.image = image;
-
-    VkDependencyInfo dependencyInfo {};
-    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-    dependencyInfo.imageMemoryBarrierCount = 1;
-    dependencyInfo.pImageMemoryBarriers = &imageBarrier;
-
-    vkCmdPipelineBarrier2(cmd, &dependencyInfo);
-}
-
 VkCommandBufferBeginInfo command_buffer_begin_info(VkCommandBufferUsageFlags flags) {
     VkCommandBufferBeginInfo beginInfo {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -578,13 +1143,6 @@ VkCommandBufferBeginInfo command_buffer_begin_info(VkCommandBufferUsageFlags fla
     return beginInfo;
 }
 
-VkFenceCreateInfo fence_create_info(VkFenceCreateFlags flags) {
-    VkFenceCreateInfo fenceCreateInfo {};
-    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceCreateInfo.flags = flags;
-    return fenceCreateInfo;
-}
-
 VkSemaphoreCreateInfo semaphore_create_info(VkSemaphoreCreateFlags flags) {
     VkSemaphoreCreateInfo semaphoreCreateInfo {};
     semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -593,50 +1151,69 @@ VkSemaphoreCreateInfo semaphore_create_info(VkSemaphoreCreateFlags flags) {
 }
 
 void init_descriptors() {
-    // Create a descriptor pool that will hold 10 sets with 1 image each
-    std::vector<cioran::DescriptorAllocator::PoolSizeRatio> poolSizes = {
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
-    };
+    // Instead of a descriptor set per shader, with its own pool and layout, every shader gets the same bindless set.
+    // The set is allocated once, and resources are added to it as they are created.
+    descriptor_layout_cache.init(vk_device);
+    pipeline_layout_cache.init(vk_device);
 
-    // The flow for descriptor sets are
-    // 1. Create a descriptor Set Pool
-    // 2. Create Descriptor Layout bindings, which describe a binding index for a shader stage,
-    // And the type of descriptor that is bound to it.
-    // 3. Build a descriptor set layout from those layout bindings
-    // 4. Allocate a descriptor set from the pool using the descriptor set layout
-    global_descriptor_allocator.init_pool(vk_device, 10, poolSizes);
+    // The deletion queue runs backwards, so the caches outlive everything that holds layouts from them.
+    main_deletion_queue.push_function([=]() {
+        std::cout << "Destroying layout caches!" << std::endl;
+        pipeline_layout_cache.destroy();
+        descriptor_layout_cache.destroy();
+    });
 
-    // Make the descriptor set layout for our compute draw
-    
-    cioran::DescriptorLayoutBuilder layoutBuilder;
-    layoutBuilder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-    draw_image_descriptor_layout = layoutBuilder.build(vk_device, VK_SHADER_STAGE_COMPUTE_BIT);
+    // With the buffer backend, pipelines can't bind regular sets, so the heap goes into a descriptor buffer too.
+    bindless_heap.init(vk_device, vk_physical_device, descriptor_layout_cache,
+        descriptor_backend == cioran::DescriptorBackend::buffer ? vma_allocator : VK_NULL_HANDLE);
 
-    draw_image_descriptors = global_descriptor_allocator.allocate(vk_device, draw_image_descriptor_layout);
+    main_deletion_queue.push_function([=]() {
+        std::cout << "Cleaning up descriptors!" << std::endl;
+        bindless_heap.destroy();
+    });
+}
 
-    VkDescriptorImageInfo imageInfo {};
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    imageInfo.imageView = draw_image.image_view;
+void init_pipelines() {
+    // The gradient takes the bindless heap at set 0, and the index of the draw image and the address of its parameters as push constants
+    cioran::ComputePipelineBuilder builder;
+    builder.add_set_layout(bindless_heap.layout);
+    builder.add_push_constant_range(sizeof(cioran::ComputePushConstants));
+
+    // Pipelines whose sets are in descriptor buffers have to be created for them.
+    VkPipelineCreateFlags pipeline_flags = descriptor_backend == cioran::DescriptorBackend::buffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+
+    gradient_effect.name = "gradient";
+    gradient_effect.shader_file = "gradient.comp.spv";
+    gradient_effect.pipeline_flags = pipeline_flags;
+    gradient_effect.layout = builder.build_layout(pipeline_layout_cache);
+    // The workgroup size is picked for the device, and baked into the pipeline through specialization constants.
+    cioran::WorkgroupSize workgroup_size = cioran::choose_workgroup_size_2d(cioran::query_compute_device_info(vk_physical_device));
+    gradient_effect.set_workgroup_size(workgroup_size);
+    std::cout << "Compute workgroup size: " << workgroup_size.x << "x" << workgroup_size.y << std::endl;
+    if (!gradient_effect.build_pipeline(vk_device, pipeline_cache.cache, &gradient_effect.pipeline)) {
+        terminate();
+    }
 
-    VkWriteDescriptorSet draw_image_write = {};
-    draw_image_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    draw_image_write.pNext = nullptr;
-    draw_image_write.pTexelBufferView = nullptr;
+    // The spotlight reads the draw image through the bindless heap, and writes its output image through set 1.
+    spotlight_set_layout.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, offsetof(SpotlightDescriptors, output_image));
+    spotlight_set_layout.build(vk_device, descriptor_layout_cache, VK_SHADER_STAGE_COMPUTE_BIT, descriptor_backend);
 
-    draw_image_write.dstBinding = 0;
-    draw_image_write.dstSet = draw_image_descriptors;
-    draw_image_write.descriptorCount = 1;
-    draw_image_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    draw_image_write.pImageInfo = &imageInfo;
+    builder.add_set_layout(spotlight_set_layout.layout);
 
-    vkUpdateDescriptorSets(vk_device, 1, &draw_image_write, 0, nullptr);
+    spotlight_effect.name = "spotlight";
+    spotlight_effect.shader_file = "spotlight.comp.spv";
+    spotlight_effect.pipeline_flags = pipeline_flags;
+    spotlight_effect.layout = builder.build_layout(pipeline_layout_cache);
+    spotlight_set_layout.build_push_template(vk_device, VK_PIPELINE_BIND_POINT_COMPUTE, spotlight_effect.layout, 1);
+    spotlight_effect.set_workgroup_size(workgroup_size);
+    if (!spotlight_effect.build_pipeline(vk_device, pipeline_cache.cache, &spotlight_effect.pipeline)) {
+        terminate();
+    }
 
-    // Make sure both the descriptor allocator and the new layout get cleaned up properly
     main_deletion_queue.push_function([=]() {
-        std::cout << "Cleaning up descriptors!" << std::endl;
-
-        global_descriptor_allocator.destroy_pool(vk_device);
-
-        vkDestroyDescriptorSetLayout(vk_device, draw_image_descriptor_layout, nullptr);
+        std::cout << "Destroying pipelines!" << std::endl;
+        gradient_effect.destroy(vk_device);
+        spotlight_effect.destroy(vk_device);
+        spotlight_set_layout.destroy(vk_device);
     });
 }
\ No newline at end of file